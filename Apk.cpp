@@ -1,16 +1,24 @@
 #include "Apk.h"
+#include "DexCache.h"
+#include "DexReader.h"
+#include "InflatePipeline.h"
+#include "Parallel.h"
 
 #include <ValueVisitor.h>
 #include <android-base/stringprintf.h>
-#include <androidfw/AssetManager.h>
+#include <android-base/unique_fd.h>
 #include <dex/dex_file-inl.h>
 #include <dex/dex_file.h>
 #include <dex/dex_file_loader.h>
 #include <io/StringStream.h>
-#include <io/ZipArchive.h>
 #include <text/Printer.h>
 #include <utils/String8.h>
 
+#include <fcntl.h>
+
+#include <cerrno>
+#include <cstring>
+
 using ::android::ConfigDescription;
 using ::android::base::StringPrintf;
 
@@ -19,14 +27,18 @@ namespace apkparser {
 class XmlPrinter : public aapt::xml::ConstVisitor {
 private:
     aapt::text::Printer* printer_;
-    android::AssetManager* assetManager_;
+    std::function<const ArscTable*()> loadTable_;
+    // 第一次解析引用时才加载
+    const ArscTable* table_ = nullptr;
+    bool tableLoaded_ = false;
     android::ResTable_config config_;
     std::map<std::string, std::string> displayNames_;
     std::map<std::string, std::string> namespace_uri_prefix_; // 记录uri和prefix的对应关系
 
 public:
-    explicit XmlPrinter(aapt::text::Printer* printer, android::AssetManager* assetManager)
-          : printer_(printer), assetManager_(assetManager) {
+    /// @param loadTable 加载资源表, 只在属性引用了资源时调用一次, 可以返回nullptr
+    XmlPrinter(aapt::text::Printer* printer, std::function<const ArscTable*()> loadTable)
+          : printer_(printer), loadTable_(std::move(loadTable)) {
         android::ResTable_config config;
         memset(&config, 0, sizeof(android::ResTable_config));
         config.language[0] = 'e';
@@ -41,7 +53,14 @@ public:
         config.smallestScreenWidthDp = 320;
         config.screenLayout |= android::ResTable_config::SCREENSIZE_NORMAL;
         config_ = config;
-        assetManager_->setConfiguration(config_);
+    }
+
+    const ArscTable* GetTable() {
+        if (!tableLoaded_) {
+            tableLoaded_ = true;
+            table_ = loadTable_();
+        }
+        return table_;
     }
 
     std::map<std::string, std::string> GetDisplayNames() { return displayNames_; }
@@ -75,59 +94,21 @@ public:
                 }
                 return "";
             }
-            // 转换成android::Res_value
-            android::Res_value resValue;
-            resValue.dataType = android::Res_value::TYPE_REFERENCE;
-            resValue.data = ref->id.value().id;
             // 开始解决引用
-            if (!assetManager_) {
+            const ArscTable* table = GetTable();
+            if (table == nullptr) {
                 if (outError != NULL) {
-                    *outError = "asset manager is null";
+                    *outError = "resource table is null";
                 }
                 return "";
             }
-            const android::ResTable& resTable = assetManager_->getResources(false);
-            if (resTable.getError() != android::NO_ERROR) {
-                if (outError != NULL) {
-                    *outError = "resTable has err:" + android::statusToString(resTable.getError());
-                }
-                return "";
-            }
-            // 判断资源对应的package是否存在
-            auto resPackagExist = [](const android::ResTable& resTable,
-                                     const android::Res_value& resValue) {
-                for (size_t i = 0; i < resTable.getBasePackageCount(); i++) {
-                    if (resTable.getBasePackageId(i) == (resValue.data >> 24)) {
-                        return true;
-                    }
-                }
-                return false;
-            };
-            if (!resPackagExist(resTable, resValue)) {
+            std::string error;
+            if (!table->ResolveString(ref->id.value().id, config_, &attr_value, &error)) {
                 if (outError != NULL) {
-                    *outError = "resource`s package not exist";
+                    *outError = error;
                 }
                 return "";
             }
-            // 处理引用
-            ssize_t block = resTable.resolveReference(&resValue, 0);
-            if (block < 0) {
-                if (outError != NULL) {
-                    *outError = "attribute value reference does not exist";
-                }
-                return "";
-            }
-            if (resValue.dataType != android::Res_value::TYPE_STRING) {
-                if (outError != NULL) {
-                    *outError = "attribute is not a string value";
-                }
-                return "";
-            }
-
-            size_t len;
-            const char16_t* str =
-                    resTable.valueToString(&resValue, static_cast<size_t>(block), NULL, &len);
-            attr_value = str ? android::String8(str, len).c_str() : "";
         }
         return attr_value;
     }
@@ -135,37 +116,45 @@ public:
     std::map<std::string, std::string> getApplicationLabels(const aapt::xml::Attribute& attr,
                                                             std::string* outError) {
         std::map<std::string, std::string> displayNames;
-        if (!assetManager_) {
+        const ArscTable* table = GetTable();
+        if (table == nullptr) {
             if (outError != NULL) {
-                *outError = "asset manager is null";
+                *outError = "resource table is null";
             }
             return displayNames;
         }
-        const android::ResTable& resTable = assetManager_->getResources(false);
-        if (resTable.getError() != android::NO_ERROR) {
-            if (outError != NULL) {
-                *outError = "resTable has err:" + android::statusToString(resTable.getError());
+        std::set<std::string> locales = table->GetLocales();
+        std::map<std::string, std::string> labels;
+        auto ref = attr.compiled_value ? aapt::ValueCast<aapt::Reference>(attr.compiled_value.get())
+                                       : nullptr;
+        if (ref != nullptr) {
+            // 引用的资源只遍历一次, 在内存中为每种语言选择最匹配的值
+            std::string error;
+            if (!ref->id || !ref->id.value().is_valid()) {
+                error = "reference id invalid";
+            } else {
+                table->ResolveStringPerLocale(ref->id.value().id, config_, locales, &labels,
+                                              &error);
+            }
+            if (outError != NULL && labels.empty()) {
+                *outError = error;
+            }
+        } else {
+            // 不是引用时和语言无关
+            std::string label = resolveAttribute(attr, outError);
+            for (const std::string& locale : locales) {
+                labels[locale] = label;
             }
-            return displayNames;
         }
-        android::Vector<android::String8> locales;
-        resTable.getLocales(&locales);
-        for (size_t i = 0; i < locales.size(); i++) {
-            const char* localeStr = locales[i].string();
-            assetManager_->setConfiguration(config_, localeStr != NULL ? localeStr : "");
-            std::string llabel = resolveAttribute(attr, outError);
-            if (llabel != "") {
-                if (localeStr == NULL || strlen(localeStr) == 0) {
-                    displayNames["application-label"] =
-                            android::ResTable::normalizeForOutput(llabel.c_str()).string();
-                } else {
-                    std::string key = StringPrintf("application-label-%s", localeStr);
-                    displayNames[key] =
-                            android::ResTable::normalizeForOutput(llabel.c_str()).string();
-                }
+        for (const auto& [locale, label] : labels) {
+            if (label.empty()) {
+                continue;
             }
+            std::string key = locale.empty()
+                    ? "application-label"
+                    : StringPrintf("application-label-%s", locale.c_str());
+            displayNames[key] = android::ResTable::normalizeForOutput(label.c_str()).string();
         }
-        assetManager_->setConfiguration(config_);
         return displayNames;
     }
 
@@ -237,35 +226,107 @@ public:
 };
 
 std::unique_ptr<Apk> Apk::LoadApkFromPath(const std::string& path) {
-    // 加载zip文件
-    aapt::Source source(path);
+    // 映射apk并解析中央目录, 文件集合和资源表共用这一份映像
+    std::string error;
+    std::shared_ptr<ZipImage> image = ZipImage::OpenPath(path, &error);
+    if (!image) {
+        std::cerr << "failed opening zip: " << error << std::endl;
+        return {};
+    }
+    return LoadApkFromImage(std::move(image));
+}
+
+std::unique_ptr<Apk> Apk::LoadApkFromFd(int fd, const std::string& name) {
+    std::string error;
+    std::shared_ptr<ZipImage> image = ZipImage::OpenFd(fd, name, &error);
+    if (!image) {
+        std::cerr << "failed opening zip: " << error << std::endl;
+        return {};
+    }
+    return LoadApkFromImage(std::move(image));
+}
+
+std::unique_ptr<Apk> Apk::LoadApkFromMemory(const void* data, size_t size,
+                                            const std::string& name) {
     std::string error;
-    std::unique_ptr<aapt::io::ZipFileCollection> collection =
-            aapt::io::ZipFileCollection::Create(path, &error);
-    if (!collection) {
+    std::shared_ptr<ZipImage> image = ZipImage::OpenMemory(data, size, name, &error);
+    if (!image) {
         std::cerr << "failed opening zip: " << error << std::endl;
         return {};
     }
-    // 创建AssetManager, 并加载resource.arsc
-    std::unique_ptr<android::AssetManager> assetManager(new android::AssetManager());
-    // addAssetPath 只要是规则的文件都能添加成功, 比如zip格式
-    // getResources(false) 如果没有资源,会先添加一个空资源包,然后返回空资源包, 所以不会得到ERROR
-    // 所以用getTableStringBlock函数判断是否有资源
-    // if (!assetManager.get()->addAssetPath(android::String8(path.c_str()), NULL) ||
-    //     assetManager.get()->getResources(false).getError() != android::NO_ERROR ||
-    //     assetManager.get()->getResources(false).getTableStringBlock(0)->getError() !=
-    //             android::NO_ERROR) {
-    //     std::cerr << "failed to load resource.arsc" << std::endl;
-    //     return {};
-    // }
-    if (!assetManager.get()->addAssetPath(android::String8(path.c_str()), NULL)) {
-        std::cerr << "failed to load resource" << std::endl;
+    return LoadApkFromImage(std::move(image));
+}
+
+std::unique_ptr<Apk> Apk::LoadApkFromData(std::unique_ptr<aapt::io::IData> data,
+                                          const std::string& name) {
+    std::string error;
+    std::shared_ptr<ZipImage> image = ZipImage::OpenData(std::move(data), name, &error);
+    if (!image) {
+        std::cerr << "failed opening zip: " << error << std::endl;
         return {};
     }
-    std::unique_ptr<Apk> result(new Apk(std::move(collection), std::move(assetManager)));
+    return LoadApkFromImage(std::move(image));
+}
+
+bool Apk::ListEntriesFromPath(const std::string& path,
+                              const std::function<bool(const ZipEntryInfo&)>& visitor) {
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        std::cerr << "failed to open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return ListEntriesFromFd(fd.get(), path, visitor);
+}
+
+bool Apk::ListEntriesFromFd(int fd, const std::string& name,
+                            const std::function<bool(const ZipEntryInfo&)>& visitor) {
+    std::string error;
+    if (!ZipImage::ListEntries(fd, name, visitor, &error)) {
+        std::cerr << "failed listing zip: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<Apk> Apk::LoadApkFromImage(std::shared_ptr<ZipImage> image) {
+    // resources.arsc在第一次使用资源表时才加载, 只解析dex的命令不会读取它
+    std::unique_ptr<aapt::io::IFileCollection> collection(new ZipImageFileCollection(image));
+    std::unique_ptr<Apk> result(new Apk(std::move(image), std::move(collection)));
     return result;
 }
 
+const ArscTable* Apk::GetArscTable() const {
+    std::call_once(resourcesOnce_, [this]() {
+        const ZipEntryInfo* arsc = image_->Find(kApkResourceTablePath);
+        if (arsc == nullptr) {
+            return;
+        }
+        // resources.arsc通常是stored的, 得到的是映像中的视图, LoadedArsc直接引用, 全程不拷贝
+        std::unique_ptr<aapt::io::IData> data = image_->OpenEntry(*arsc);
+        if (!data) {
+            std::cerr << "failed to load resource" << std::endl;
+            return;
+        }
+        std::string error;
+        arscTable_ = ArscTable::Load(std::move(data), &error);
+        if (!arscTable_) {
+            std::cerr << error << std::endl;
+        }
+    });
+    return arscTable_.get();
+}
+
+android::status_t Apk::GetResourceStatus() const {
+    if (image_->Find(kApkResourceTablePath) == nullptr) {
+        return android::NO_INIT;
+    }
+    const ArscTable* table = GetArscTable();
+    if (table == nullptr) {
+        return android::UNKNOWN_ERROR;
+    }
+    return table->GetStringPool()->getError();
+}
+
 std::unique_ptr<std::pair<std::string, std::map<std::string, std::string>>> Apk::GetManifest()
         const {
     std::unique_ptr<std::pair<std::string, std::map<std::string, std::string>>> result(
@@ -274,14 +335,9 @@ std::unique_ptr<std::pair<std::string, std::map<std::string, std::string>>> Apk:
     if (manifest_file == nullptr) {
         return result;
     }
-    // 判断是否存在resource.arsc, 如果不存在返回空对象
-    const android::ResStringPool* pool =
-            assetManager_.get()->getResources(false).getTableStringBlock(0);
-    if (pool->getError() == android::NO_INIT) { // 没有arsc
+    // 判断是否存在resource.arsc, 如果不存在返回空对象. 资源表等到属性引用资源时才加载
+    if (image_->Find(kApkResourceTablePath) == nullptr) {
         return result;
-    } else if (pool->getError() != android::NO_ERROR) {
-        std::cerr << "string pool is corrupt/invalid." << std::endl;
-        return {};
     }
 
     std::unique_ptr<aapt::io::IData> manifest_data = manifest_file->OpenAsData();
@@ -298,36 +354,297 @@ std::unique_ptr<std::pair<std::string, std::map<std::string, std::string>>> Apk:
     }
     aapt::io::StringOutputStream sout(&result.get()->first);
     aapt::text::Printer printer(&sout);
-    XmlPrinter xml_visitor(&printer, this->assetManager_.get());
+    XmlPrinter xml_visitor(&printer, [this]() { return GetArscTable(); });
     manifest->root->Accept(&xml_visitor);
     sout.Flush();
     result.get()->second = xml_visitor.GetDisplayNames();
     return result;
 }
 
-std::unique_ptr<std::list<std::string>> Apk::GetStrings() const {
-    std::unique_ptr<std::list<std::string>> result(new std::list<std::string>());
-    // 判断是否存在resource.arsc, 如果不存在返回空对象
-    const android::ResStringPool* pool =
-            assetManager_.get()->getResources(false).getTableStringBlock(0);
-    // 打印字符串
-    if (pool->getError() == android::NO_INIT) { // 没有arsc
-        return result;
-    } else if (pool->getError() != android::NO_ERROR) {
+bool Apk::GetStringPoolView(StringPoolView* pool) const {
+    // 判断是否存在resource.arsc, 如果不存在返回空池
+    android::status_t status = GetResourceStatus();
+    if (status == android::NO_INIT) { // 没有arsc
+        *pool = StringPoolView();
+        return true;
+    }
+    std::string error;
+    if (status != android::NO_ERROR || !GetArscTable()->GetStringPoolView(pool, &error)) {
         std::cerr << "string pool is corrupt/invalid." << std::endl;
-        return {};
+        return false;
+    }
+    return true;
+}
+
+/// @brief 把池中[begin, end)的字符串解码到strings
+///
+/// 先按长度前缀算出总的上限一次预留, 每个字符串直接解码到预留的缓冲区中, 原地截断和删除.
+/// 和VisitStrings一致: 只跳过在第一个\0处截断后为空的字符串, 删除\r \n \t后为空的仍然输出
+static void DecodeStringRange(const StringPoolView& pool, size_t begin, size_t end,
+                              ResourceStrings* strings) {
+    size_t bytes = 0;
+    for (size_t i = begin; i < end; i++) {
+        bytes += pool.MaxUtf8Size(i);
     }
-    for (size_t i = 0; i < pool->size(); i++) {
-        auto str = pool->string8ObjectAt(i);
-        if (str.has_value() && strlen(str.value().string()) > 0) {
-            result.get()->push_back(Apk::TrimString(str.value().string()));
+    strings->Reserve(bytes, end - begin);
+    for (size_t i = begin; i < end; i++) {
+        char* dest = strings->Prepare(pool.MaxUtf8Size(i));
+        size_t length = pool.DecodeUtf8(i, dest);
+        // 和按C字符串处理一致, 在第一个\0处截断
+        const void* nul = memchr(dest, '\0', length);
+        if (nul != nullptr) {
+            length = static_cast<const char*>(nul) - dest;
         }
+        if (length == 0) {
+            continue;
+        }
+        strings->Commit(TrimInPlace(dest, length));
+    }
+}
+
+std::unique_ptr<ResourceStrings> Apk::GetStrings(const StringOptions& options) const {
+    StringPoolView pool;
+    if (!GetStringPoolView(&pool)) {
+        return {};
+    }
+    std::unique_ptr<ResourceStrings> result(new ResourceStrings());
+    size_t count = pool.size();
+    size_t workers = ResolveWorkerCount(options.threads, count);
+    if (options.parallelThreshold == 0 || count < options.parallelThreshold || workers == 1) {
+        DecodeStringRange(pool, 0, count, result.get());
+        return result;
+    }
+    // 区间数多于线程数, 长字符串集中的区间拖慢一个线程时, 其余线程继续领取剩下的区间
+    size_t ranges = workers * 4;
+    std::vector<ResourceStrings> parts(ranges);
+    ParallelFor(ranges, workers, [&](size_t index, size_t) {
+        DecodeStringRange(pool, count * index / ranges, count * (index + 1) / ranges,
+                          &parts[index]);
+    });
+    // 按区间顺序拼接, 和串行解码的顺序一致
+    size_t bytes = 0;
+    size_t strings = 0;
+    for (const ResourceStrings& part : parts) {
+        bytes += part.Buffer().size();
+        strings += part.size();
+    }
+    result->Reserve(bytes, strings);
+    for (const ResourceStrings& part : parts) {
+        result->AppendAll(part);
     }
     return result;
 }
 
-std::unique_ptr<std::pair<std::set<std::string>, std::set<std::string>>> Apk::ParseDexes() const {
-    // 提取apk中的所有dex
+bool Apk::VisitStrings(const std::function<void(std::string_view)>& visitor) const {
+    StringPoolView pool;
+    if (!GetStringPoolView(&pool)) {
+        return false;
+    }
+    std::string decoded;
+    std::string trimmed;
+    for (size_t i = 0; i < pool.size(); i++) {
+        std::string_view str;
+        if (pool.IsUtf8()) {
+            if (!pool.GetUtf8(i, &str)) {
+                continue;
+            }
+        } else {
+            decoded.resize(pool.MaxUtf8Size(i));
+            str = std::string_view(decoded.data(), pool.DecodeUtf8(i, decoded.data()));
+        }
+        // 和按C字符串处理一致, 在第一个\0处截断
+        str = str.substr(0, std::min(str.size(), str.find('\0')));
+        if (!str.empty()) {
+            visitor(TrimString(str, &trimmed));
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<const art::DexFile> Apk::OpenDexFile(const uint8_t* base, size_t size,
+                                                     const std::string& location, bool verify) {
+    if (size < sizeof(art::DexFile::Header)) {
+        return {};
+    }
+    art::DexFileLoader dexFileLoader;
+    uint32_t magic = *reinterpret_cast<const uint32_t*>(base);
+    if (!dexFileLoader.IsMagicValid(magic)) {
+        return {};
+    }
+    std::string error_msg;
+    const art::DexFile::Header* dex_header = reinterpret_cast<const art::DexFile::Header*>(base);
+    return dexFileLoader.Open(base, size, location, dex_header->checksum_,
+                              /*oat_dex_file=*/nullptr, verify, /*verify_checksum=*/false,
+                              &error_msg);
+}
+
+/// @brief 把一个dex的类描述符批量转换为类名后加入result
+static void AddDexClasses(const std::vector<std::string_view>& descriptors, DexResult* result) {
+    std::vector<std::string_view> classNames;
+    classNames.reserve(descriptors.size());
+    NormalizeClassDescriptors(descriptors, result->classes.MutableArena(), &classNames);
+    for (std::string_view className : classNames) {
+        result->classes.InternView(className);
+    }
+}
+
+/// @brief 收集类描述符, 非ASCII的描述符先转换为UTF-8, 存放在scratch中
+static void AddDescriptor(std::string_view descriptor, StringArena* scratch,
+                          std::vector<std::string_view>* descriptors) {
+    if (IsAscii(descriptor.data(), descriptor.size())) {
+        descriptors->push_back(descriptor);
+        return;
+    }
+    std::string utf8;
+    MutfToUtf8(descriptor, &utf8);
+    descriptors->push_back(scratch->Copy(utf8));
+}
+
+/// @brief 转换为UTF-8并修剪后把dex字符串加入result
+/// @return 是否有视图直接引用了dex数据
+static bool AddDexString(std::string_view str, const DexOptions& options, std::string* buffer,
+                         DexResult* result) {
+    if (str.empty()) {
+        return false;
+    }
+    std::string_view trimmed = Apk::DecodeDexString(str, buffer);
+    if (trimmed.empty()) {
+        return false;
+    }
+    // 不需要转换和修剪的字符串直接引用dex数据
+    if (options.zeroCopy && trimmed.data() == str.data()) {
+        return result->strings.InternView(trimmed);
+    }
+    result->strings.Intern(trimmed);
+    return false;
+}
+
+/// @brief 用DexReader读取类和字符串
+/// @return dex表不完整返回false
+static bool ParseDexNative(const uint8_t* base, size_t size, const DexOptions& options,
+                           DexResult* result, bool* referenced) {
+    std::string error;
+    std::unique_ptr<DexReader> reader = DexReader::Open(base, size, &error);
+    if (reader == nullptr) {
+        return false;
+    }
+    // 遍历类, 先收集所有类描述符, 再批量转换成类名
+    StringArena scratch;
+    std::vector<std::string_view> descriptors;
+    descriptors.reserve(reader->NumClassDefs());
+    std::string_view descriptor;
+    for (uint32_t i = 0; i < reader->NumClassDefs(); ++i) {
+        if (reader->GetClassDescriptor(i, &descriptor)) {
+            AddDescriptor(descriptor, &scratch, &descriptors);
+        }
+    }
+    AddDexClasses(descriptors, result);
+
+    // 遍历字符串
+    std::string buffer;
+    std::string_view str;
+    for (uint32_t i = 0; i < reader->NumStringIds(); ++i) {
+        if (reader->GetString(i, &str)) {
+            *referenced |= AddDexString(str, options, &buffer, result);
+        }
+    }
+    return true;
+}
+
+/// @brief 用libdexfile读取类和字符串
+/// @return libdexfile加载失败返回false
+static bool ParseDexLibdexfile(const uint8_t* base, size_t size, const std::string& location,
+                               const DexOptions& options, DexResult* result, bool* referenced) {
+    std::unique_ptr<const art::DexFile> dexFile = Apk::OpenDexFile(base, size, location);
+    if (dexFile == nullptr) {
+        return false;
+    }
+    // 遍历类, 先收集所有类描述符, 再批量转换成类名
+    StringArena scratch;
+    std::vector<std::string_view> descriptors;
+    descriptors.reserve(dexFile->NumClassDefs());
+    for (uint32_t i = 0; i < dexFile->NumClassDefs(); ++i) {
+        const char* descriptor = dexFile->GetClassDescriptor(dexFile->GetClassDef(i));
+        if (descriptor != nullptr) {
+            AddDescriptor(descriptor, &scratch, &descriptors);
+        }
+    }
+    AddDexClasses(descriptors, result);
+
+    // 遍历字符串
+    std::string buffer;
+    for (uint32_t i = 0; i < dexFile->NumStringIds(); ++i) {
+        const char* chars =
+                dexFile->GetStringData(dexFile->GetStringId(art::dex::StringIndex(i)));
+        if (chars != nullptr) {
+            *referenced |= AddDexString(chars, options, &buffer, result);
+        }
+    }
+    return true;
+}
+
+/// @brief 解析解压后的dex, 将类名和字符串加入result, 有视图引用dex数据时接管data
+/// @return dex无法解析返回false
+static bool ParseDexData(std::unique_ptr<aapt::io::IData> data, const std::string& location,
+                         const DexOptions& options, DexResult* result) {
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(data->data());
+    bool referenced = false;
+    bool parsed = false;
+    if (options.backend != DexBackend::kLibdexfile) {
+        parsed = ParseDexNative(base, data->size(), options, result, &referenced);
+    }
+    if (!parsed && options.backend != DexBackend::kNative) {
+        parsed = ParseDexLibdexfile(base, data->size(), location, options, result, &referenced);
+    }
+    if (referenced) {
+        result->buffers.push_back(std::move(data));
+    }
+    return parsed;
+}
+
+/// @brief 查找dex的缓存
+/// @param key 未命中时设为需要写入的缓存key, 不使用缓存时为空
+/// @return 命中时类名和字符串已加入result
+static bool LoadCachedDex(aapt::io::IFile* file, const DexOptions& options,
+                          const DexCache* cache, DexResult* result, std::string* key) {
+    key->clear();
+    return cache != nullptr && cache->ComputeKey(file->GetSource().path, key) &&
+           cache->Load(*key, options.zeroCopy, result);
+}
+
+/// @brief 解析已读取的dex, 将类名和字符串加入result
+/// @param key 不为空时解析后写入缓存
+static void ParseLoadedDex(std::unique_ptr<aapt::io::IData> data, const std::string& location,
+                           const std::string& key, const DexOptions& options,
+                           const DexCache* cache, DexResult* result) {
+    if (key.empty()) {
+        ParseDexData(std::move(data), location, options, result);
+        return;
+    }
+    // 需要写缓存时单独解析这个dex, 写入后再合并
+    DexResult single;
+    if (ParseDexData(std::move(data), location, options, &single)) {
+        cache->Store(key, single);
+    }
+    result->Merge(std::move(single));
+}
+
+/// @brief 解压并解析单个dex, 将类名和字符串加入result
+/// @param cache 不为空时先查缓存, 命中则不解压; 未命中时解析后写入缓存
+static void ParseDex(aapt::io::IFile* file, const DexOptions& options, const DexCache* cache,
+                     DexResult* result) {
+    std::string key;
+    if (LoadCachedDex(file, options, cache, result, &key)) {
+        return;
+    }
+    std::unique_ptr<aapt::io::IData> data = file->OpenAsData();
+    if (data == nullptr) {
+        return;
+    }
+    ParseLoadedDex(std::move(data), file->GetSource().path, key, options, cache, result);
+}
+
+std::vector<aapt::io::IFile*> Apk::FindDexFiles() const {
     std::vector<aapt::io::IFile*> dexes;
     auto collection = this->collection_.get();
     auto iter = collection->Iterator();
@@ -337,65 +654,108 @@ std::unique_ptr<std::pair<std::set<std::string>, std::set<std::string>>> Apk::Pa
             dexes.push_back(file);
         }
     }
-    // 解析dex
-    std::unique_ptr<std::pair<std::set<std::string>, std::set<std::string>>> result(
-            new std::pair<std::set<std::string>, std::set<std::string>>);
-    for (auto&& file : dexes) {
-        std::unique_ptr<aapt::io::IData> data = file->OpenAsData();
-        if (data == nullptr || data->size() < 4) {
-            continue;
-        }
-        const uint8_t* base = reinterpret_cast<const uint8_t*>(data->data());
-        size_t size = data->size();
-        const std::string location = file->GetSource().path;
-        art::DexFileLoader dexFileLoader;
-        uint32_t magic = *reinterpret_cast<const uint32_t*>(base);
-        if (!dexFileLoader.IsMagicValid(magic)) {
-            continue;
+    return dexes;
+}
+
+std::unique_ptr<DexResult> Apk::ParseDexes(const DexOptions& options) const {
+    // 提取apk中的所有dex
+    std::vector<aapt::io::IFile*> dexes = FindDexFiles();
+    std::unique_ptr<DexCache> cache;
+    if (!options.cacheDir.empty() && !dexes.empty()) {
+        cache = DexCache::Open(options.cacheDir, options.cacheKey, image_.get());
+    }
+    // 解析dex, 每个工作线程有独立的结果表, 避免加锁
+    std::unique_ptr<DexResult> result(new DexResult());
+    size_t workers = ResolveWorkerCount(options.threads, dexes.size());
+    size_t inflaters = options.inflateThreads != 0 ? options.inflateThreads : workers;
+    if (workers == 1 && inflaters == 1) {
+        for (auto&& file : dexes) {
+            ParseDex(file, options, cache.get(), result.get());
         }
-        std::string error_msg;
-        const art::DexFile::Header* dex_header =
-                reinterpret_cast<const art::DexFile::Header*>(base);
-        std::unique_ptr<const art::DexFile> dexFile =
-                dexFileLoader.Open(base, size, location, dex_header->checksum_,
-                                   /*oat_dex_file=*/nullptr, false, false, &error_msg);
-        if (dexFile == nullptr) {
+        return result;
+    }
+    // 先查缓存, 命中的dex不需要解压
+    std::vector<aapt::io::IFile*> pending;
+    std::vector<std::string> keys;
+    std::vector<const ZipEntryInfo*> entries;
+    for (aapt::io::IFile* file : dexes) {
+        std::string key;
+        if (LoadCachedDex(file, options, cache.get(), result.get(), &key)) {
             continue;
         }
-        // 遍历类
-        for (uint32_t i = 0; i < dexFile->NumClassDefs(); ++i) {
-            const char* descriptor = dexFile->GetClassDescriptor(dexFile->GetClassDef(i));
-            if (descriptor == nullptr || strlen(descriptor) == 0) {
-                continue;
-            }
-            // 去除首尾的 L 和; 将 / 转换为 .
-            std::string className(descriptor + 1, strlen(descriptor) - 2);
-            std::replace(className.begin(), className.end(), '/', '.');
-            // 截断匿名类, 存在多个匿名类的情况
-            auto pos = className.find("$");
-            if (pos != std::string::npos) {
-                className = className.substr(0, pos);
+        pending.push_back(file);
+        keys.push_back(std::move(key));
+        entries.push_back(image_->Find(file->GetSource().path));
+    }
+    // 解压线程立即开始解压所有dex, 解析线程从队列中领取, 解压和解析重叠进行
+    InflatePipeline pipeline(image_.get(), std::move(entries), inflaters,
+                             workers + inflaters, options.maxInflightBytes);
+    std::vector<DexResult> partials(workers);
+    ParallelFor(workers, workers, [&](size_t, size_t worker) {
+        InflatePipeline::Item item;
+        while (pipeline.Pop(&item)) {
+            if (item.data != nullptr) {
+                ParseLoadedDex(std::move(item.data), pending[item.index]->GetSource().path,
+                               keys[item.index], options, cache.get(), &partials[worker]);
             }
-            result.get()->first.insert(className);
+            pipeline.Release(item);
         }
+    });
+    // 合并结果, 合并时接管各线程的内存池和dex数据, 不拷贝字符串; 输出前统一排序, 所以和串行完全一致
+    for (auto&& partial : partials) {
+        result->Merge(std::move(partial));
+    }
+    return result;
+}
 
-        // 遍历字符串
-        for (uint32_t i = 0; i < dexFile->NumStringIds(); ++i) {
-            const char* str =
-                    dexFile->GetStringData(dexFile->GetStringId(art::dex::StringIndex(i)));
-            if (str == nullptr || strlen(str) == 0) {
-                continue;
-            }
-            std::string str2 = Apk::TrimString(str);
-            if (str2.empty()) continue;
-            result.get()->second.insert(str2);
-        }
+void Apk::VisitDexes(
+        const DexOptions& options,
+        const std::function<void(const std::string& location, DexResult& result)>& visitor)
+        const {
+    std::vector<aapt::io::IFile*> dexes = FindDexFiles();
+    std::unique_ptr<DexCache> cache;
+    if (!options.cacheDir.empty() && !dexes.empty()) {
+        cache = DexCache::Open(options.cacheDir, options.cacheKey, image_.get());
     }
+    OrderedParallelFor<std::unique_ptr<DexResult>>(
+            dexes.size(), options.threads,
+            [&](size_t index) {
+                // 每个dex独立的结果表, 不和其它dex去重
+                std::unique_ptr<DexResult> result(new DexResult());
+                ParseDex(dexes[index], options, cache.get(), result.get());
+                return result;
+            },
+            [&](size_t index, std::unique_ptr<DexResult>&& result) {
+                visitor(dexes[index]->GetSource().path, *result);
+            });
+}
 
-    return result;
+void Apk::VisitDexMembers(const DexOptions& options,
+                          const std::function<void(const DexMembers&)>& visitor) const {
+    std::vector<aapt::io::IFile*> dexes = FindDexFiles();
+    OrderedParallelFor<std::unique_ptr<DexMembers>>(
+            dexes.size(), options.threads,
+            [&](size_t index) {
+                std::unique_ptr<DexMembers> members(new DexMembers());
+                members->location = dexes[index]->GetSource().path;
+                std::unique_ptr<aapt::io::IData> data = dexes[index]->OpenAsData();
+                std::string error = "failed to read entry";
+                if (data == nullptr || !ExtractDexMembers(std::move(data), members.get(), &error)) {
+                    std::cerr << "failed to extract members of " << members->location << ": "
+                              << error << std::endl;
+                    return std::unique_ptr<DexMembers>();
+                }
+                return members;
+            },
+            [&](size_t index, std::unique_ptr<DexMembers>&& members) {
+                if (members != nullptr) {
+                    visitor(*members);
+                }
+            });
 }
 
-std::unique_ptr<nlohmann::json> Apk::DoAllTasks() const {
+std::unique_ptr<nlohmann::json> Apk::DoAllTasks(const DexOptions& options,
+                                                const StringOptions& stringOptions) const {
     // 解析manifest
     // auto now = std::chrono::system_clock::now();
     auto manifest = this->GetManifest();
@@ -408,7 +768,7 @@ std::unique_ptr<nlohmann::json> Apk::DoAllTasks() const {
     // std::cout << "parse manifest cost " << duration.count() << "ms" << std::endl;
     // 解析资源字符串
     // now = std::chrono::system_clock::now();
-    auto strings = this->GetStrings();
+    auto strings = this->GetStrings(stringOptions);
     if (!strings) {
         std::cerr << "parse strings failed" << std::endl;
         return {};
@@ -418,7 +778,7 @@ std::unique_ptr<nlohmann::json> Apk::DoAllTasks() const {
     // std::cout << "parse strings cost " << duration.count() << "ms" << std::endl;
     // 解析dexes
     // auto now = std::chrono::system_clock::now();
-    auto dexes = this->ParseDexes();
+    auto dexes = this->ParseDexes(options);
     if (!dexes) {
         std::cerr << "parse dexes failed" << std::endl;
         return {};
@@ -431,10 +791,10 @@ std::unique_ptr<nlohmann::json> Apk::DoAllTasks() const {
     result.get()->operator[]("manifest") = manifest.get()->first;
     result.get()->operator[]("display_names") = manifest.get()->second;
     nlohmann::json resStrings;
-    resStrings["strings"] = *strings.get();
+    resStrings["strings"] = strings->Views();
     result.get()->operator[]("resources_arsc") = resStrings;
-    result.get()->operator[]("dex_classes") = dexes.get()->first;
-    result.get()->operator[]("dex_strings") = dexes.get()->second;
+    result.get()->operator[]("dex_classes") = dexes->classes.Sorted();
+    result.get()->operator[]("dex_strings") = dexes->strings.Sorted();
     return result;
 }
 
@@ -1,30 +1,224 @@
 #ifndef APKPARSER_APK_H
 #define APKPARSER_APK_H
 
-#include <androidfw/AssetManager.h>
+#include <androidfw/ResourceTypes.h>
 #include <io/File.h>
 #include <xml/XmlDom.h>
 
 #include <json.hpp>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
 #include <set>
 
+#include "ArscTable.h"
+#include "DexMembers.h"
+#include "StringKernels.h"
+#include "StringTable.h"
+#include "ZipImage.h"
+
+namespace art {
+class DexFile;
+} // namespace art
+
 namespace apkparser {
 
 constexpr static const char kApkResourceTablePath[] = "resources.arsc";
 constexpr static const char kAndroidManifestPath[] = "AndroidManifest.xml";
 
+/// @brief 资源字符串池解码后的字符串, 按池中的顺序首尾相接存放在一块连续的UTF-8缓冲区中
+class ResourceStrings {
+private:
+    std::string buffer_;
+    /// 第i个字符串为buffer_[offsets_[i], offsets_[i + 1])
+    std::vector<size_t> offsets_{0};
+
+public:
+    class const_iterator {
+    private:
+        const ResourceStrings* strings_;
+        size_t index_;
+
+    public:
+        const_iterator(const ResourceStrings* strings, size_t index)
+              : strings_(strings), index_(index){};
+        std::string_view operator*() const { return (*strings_)[index_]; }
+        const_iterator& operator++() {
+            index_++;
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const { return index_ != other.index_; }
+    };
+
+    /// @brief 预留count个字符串共bytes字节, 之后Prepare不超过预留量时不会重新分配
+    void Reserve(size_t bytes, size_t count) {
+        if (buffer_.size() < offsets_.back() + bytes) {
+            buffer_.resize(offsets_.back() + bytes);
+        }
+        offsets_.reserve(offsets_.size() + count);
+    }
+
+    /// @brief 下一个字符串的写入位置, 至少有capacity字节, 写入后调用Commit确认长度
+    char* Prepare(size_t capacity) {
+        size_t used = offsets_.back();
+        if (buffer_.size() < used + capacity) {
+            buffer_.resize(std::max(used + capacity, buffer_.size() * 2));
+        }
+        return buffer_.data() + used;
+    }
+
+    /// @brief 确认Prepare之后写入的size字节为一个字符串
+    void Commit(size_t size) { offsets_.push_back(offsets_.back() + size); }
+
+    void Append(std::string_view str) {
+        memcpy(Prepare(str.size()), str.data(), str.size());
+        Commit(str.size());
+    }
+
+    /// @brief 按顺序追加other中的所有字符串
+    void AppendAll(const ResourceStrings& other) {
+        std::string_view buffer = other.Buffer();
+        size_t base = offsets_.back();
+        memcpy(Prepare(buffer.size()), buffer.data(), buffer.size());
+        for (size_t i = 1; i < other.offsets_.size(); i++) {
+            offsets_.push_back(base + other.offsets_[i]);
+        }
+    }
+
+    size_t size() const { return offsets_.size() - 1; }
+
+    bool empty() const { return size() == 0; }
+
+    std::string_view operator[](size_t index) const {
+        return std::string_view(buffer_).substr(offsets_[index],
+                                                offsets_[index + 1] - offsets_[index]);
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    /// @brief 所有字符串的视图, 用于转换为json
+    std::vector<std::string_view> Views() const {
+        std::vector<std::string_view> views;
+        views.reserve(size());
+        for (std::string_view str : *this) {
+            views.push_back(str);
+        }
+        return views;
+    }
+
+    /// @brief 所有字符串共用的缓冲区, 不含预留的空间
+    std::string_view Buffer() const { return std::string_view(buffer_.data(), offsets_.back()); }
+
+    /// @brief size() + 1个偏移, 第一个为0, 最后一个为Buffer().size()
+    const std::vector<size_t>& Offsets() const { return offsets_; }
+};
+
+/// @brief dex解析结果, 所有dex的类名和字符串分别去重
+struct DexResult {
+    StringTable classes;
+    StringTable strings;
+    /// 零拷贝模式下strings中的视图指向这些dex数据, 需要和结果一起保留.
+    /// stored的dex是apk映像中的视图, 会让映像在结果存活期间保持映射
+    std::vector<std::unique_ptr<aapt::io::IData>> buffers;
+
+    /// @brief 合并other的类名、字符串和dex数据
+    void Merge(DexResult&& other) {
+        classes.Merge(std::move(other.classes));
+        strings.Merge(std::move(other.strings));
+        for (auto& buffer : other.buffers) {
+            buffers.push_back(std::move(buffer));
+        }
+        other.buffers.clear();
+    }
+};
+
+/// @brief 代码中引用的方法、字段和字符串常量, 签名格式和dex-members一致
+struct InvokeResult {
+    /// invoke-*调用的方法
+    StringTable methods;
+    /// iget/iput/sget/sput访问的字段
+    StringTable fields;
+    /// const-string加载的字符串
+    StringTable strings;
+    /// 指令预算耗尽, 结果不完整
+    bool truncated = false;
+};
+
+/// @brief dex的读取方式
+enum class DexBackend {
+    /// 先用DexReader读取, 失败时回退到libdexfile
+    kAuto,
+    /// 只用DexReader, 直接读取header和各个表
+    kNative,
+    /// 只用art::DexFileLoader
+    kLibdexfile,
+};
+
+/// @brief dex缓存的key
+enum class DexCacheKey {
+    /// zip条目的CRC32和解压后大小, 只读中央目录, 命中时不需要解压
+    kEntry,
+    /// dex header中的checksum和signature, 只需要解压header
+    kHeader,
+};
+
+/// @brief dex解析选项
+struct DexOptions {
+    /// 并行解析dex的线程数, 0表示使用cpu核数, 1表示串行
+    size_t threads = 1;
+    /// 零拷贝模式: 保留dex数据, 字符串直接引用dex中的MUTF-8数据,
+    /// 只有含\r \n \t需要修剪的字符串才拷贝. 代价是结果存活期间dex数据不释放
+    bool zeroCopy = true;
+    DexBackend backend = DexBackend::kAuto;
+    /// 持久化缓存目录, 为空时不使用缓存
+    std::string cacheDir;
+    DexCacheKey cacheKey = DexCacheKey::kEntry;
+    /// 扫描代码时整个apk最多解码的指令数, 0表示不限制
+    uint64_t instructionBudget = 0;
+    /// 解压deflate压缩的dex的线程数, 0表示和threads相同.
+    /// threads和inflateThreads都为1时串行解压和解析, 否则解压和解析在不同线程上流水进行
+    size_t inflateThreads = 0;
+    /// 流水线中已解压但还没解析完的最大字节数, 单个超过上限的dex仍然可以解压
+    uint64_t maxInflightBytes = 512ull << 20;
+};
+
+/// @brief 资源字符串池解码选项
+struct StringOptions {
+    /// 并行解码的线程数, 0表示使用cpu核数, 1表示串行
+    size_t threads = 1;
+    /// 字符串数不少于该值时按下标区间并行解码, 0表示总是串行. 小的池启动线程的开销大于收益
+    size_t parallelThreshold = 50000;
+};
+
 class Apk {
 private:
+    std::shared_ptr<ZipImage> image_;
     std::unique_ptr<aapt::io::IFileCollection> collection_;
-    std::unique_ptr<android::AssetManager> assetManager_;
+    /// resources.arsc在第一次调用GetArscTable时加载, 资源表直接引用arsc的数据
+    mutable std::once_flag resourcesOnce_;
+    mutable std::unique_ptr<ArscTable> arscTable_;
+
+    /// @brief 资源表的状态
+    /// @return 没有resources.arsc返回NO_INIT, 读取或加载失败返回UNKNOWN_ERROR,
+    ///         全局字符串池损坏返回对应错误
+    android::status_t GetResourceStatus() const;
+
+    /// @brief 全局字符串池的原始数据视图, 没有resources.arsc时为空池
+    /// @return 字符串池损坏返回false
+    bool GetStringPoolView(StringPoolView* pool) const;
 
 public:
-    Apk(std::unique_ptr<aapt::io::IFileCollection> collection,
-        std::unique_ptr<android::AssetManager> assetManager)
-          : collection_(std::move(collection)), assetManager_(std::move(assetManager)){};
+    Apk(std::shared_ptr<ZipImage> image, std::unique_ptr<aapt::io::IFileCollection> collection)
+          : image_(std::move(image)), collection_(std::move(collection)){};
     ~Apk() = default;
 
-    android::AssetManager* GetAssetManager() const { return assetManager_.get(); }
+    /// @brief 资源表, 第一次调用时加载resources.arsc, 可以在多个线程上调用
+    /// @return 没有resources.arsc或读取失败返回nullptr
+    const ArscTable* GetArscTable() const;
+
+    const ZipImage* GetImage() const { return image_.get(); }
 
     aapt::io::IFileCollection* GetFileCollection() const { return collection_.get(); }
 
@@ -33,28 +227,139 @@ public:
     /// @return 失败返回nullptr
     static std::unique_ptr<Apk> LoadApkFromPath(const std::string& path);
 
+    /// @brief 在已打开的映像上创建文件集合并加载resources.arsc
+    /// @return 失败返回nullptr
+    static std::unique_ptr<Apk> LoadApkFromImage(std::shared_ptr<ZipImage> image);
+
+    /// @brief 从已打开的fd加载apk, 不接管fd. 普通文件直接mmap, 管道(如stdin)读到内存中
+    /// @param name 用于错误信息和文件来源
+    /// @return 失败返回nullptr
+    static std::unique_ptr<Apk> LoadApkFromFd(int fd, const std::string& name = "-");
+
+    /// @brief 从内存中的apk加载, 不拷贝数据
+    /// @param data apk以及零拷贝的解析结果存活期间必须有效
+    /// @return 失败返回nullptr
+    static std::unique_ptr<Apk> LoadApkFromMemory(const void* data, size_t size,
+                                                  const std::string& name = "-");
+
+    /// @brief 从IData加载apk并接管它, 例如外层zip中的内层apk, 不写临时文件
+    /// @param name 用于错误信息和文件来源
+    /// @return 失败返回nullptr
+    static std::unique_ptr<Apk> LoadApkFromData(std::unique_ptr<aapt::io::IData> data,
+                                                const std::string& name);
+
+    /// @brief 只读取中央目录, 逐个回调条目, 不加载resources.arsc也不解压任何数据
+    /// @param visitor 条目的name和extra只在回调期间有效, 返回false时停止遍历
+    /// @return 打开失败或中央目录损坏返回false
+    static bool ListEntriesFromPath(const std::string& path,
+                                    const std::function<bool(const ZipEntryInfo&)>& visitor);
+
+    /// @brief 同ListEntriesFromPath, 从已打开的fd读取, 不接管fd
+    static bool ListEntriesFromFd(int fd, const std::string& name,
+                                  const std::function<bool(const ZipEntryInfo&)>& visitor);
+
     /// @brief 解析manifest 和 application-label
     /// @return 失败返回nullptr, 没有resources.arsc和AndroidManifest.xml返回空字符串
     std::unique_ptr<std::pair<std::string, std::map<std::string, std::string>>> GetManifest() const;
 
-    /// @brief 获取resource.arsc中的字符串池
+    /// @brief 获取resource.arsc中的字符串池, 去掉空字符串, 删除\r \n \t
+    ///
+    /// 大的池按下标分成若干区间, 各线程解码到自己的缓冲区后按顺序拼接, 结果和串行完全一致
     /// @return 失败返回nullptr, 没有resources.arsc或其中没有字符串,返回空字符串列表
-    std::unique_ptr<std::list<std::string>> GetStrings() const;
+    std::unique_ptr<ResourceStrings> GetStrings(
+            const StringOptions& options = StringOptions()) const;
+
+    /// @brief 按池中的顺序逐个解码字符串并交给visitor, 不保存任何字符串
+    ///
+    /// UTF-8的池直接引用arsc中的数据, UTF-16的池解码到复用的缓冲区, 不为每个字符串分配内存
+    /// @param visitor 字符串只在回调期间有效
+    /// @return 字符串池损坏返回false, 没有resources.arsc返回true
+    bool VisitStrings(const std::function<void(std::string_view)>& visitor) const;
+
+    /// @brief 解析所有dex的class和string, 最后合并结果
+    ///
+    /// 多线程时解压线程在中央目录读取后立即开始解压所有dex, 通过有界队列交给解析线程,
+    /// 在途的解压数据受maxInflightBytes限制; 每个解析线程有独立的结果表
+    /// @param options 解析选项, 结果与线程数无关
+    /// @return 永远不会返回nullptr, 没有dex返回空表
+    std::unique_ptr<DexResult> ParseDexes(const DexOptions& options = DexOptions()) const;
+
+    /// @brief 流式解析dex: 每个dex单独解析出类名和字符串, 只在dex内部去重
+    ///
+    /// visitor按dex顺序串行调用, 可能在不同的工作线程上, 调用结束后该dex的结果和数据
+    /// (零拷贝时被引用的IData)立即释放, 峰值内存只和同时处理的dex数量
+    /// (串行时为1, 否则最多为线程数的2倍)有关, 和apk中dex的总大小无关
+    /// @param options 解析选项, 可以使用缓存
+    /// @param visitor visitor(location, result), 无法读取的dex被跳过
+    void VisitDexes(const DexOptions& options,
+                    const std::function<void(const std::string& location, DexResult& result)>&
+                            visitor) const;
 
-    /// @brief 解析所有dex的class和string
-    /// @return 永远不会返回nullptr, 没有dex返回空列表
-    std::unique_ptr<std::pair<std::set<std::string>, std::set<std::string>>> ParseDexes() const;
+    /// @brief 提取所有dex的type_ids、field_ids、method_ids签名, 按dex流式输出
+    ///
+    /// 每个dex在工作线程上解压和渲染, visitor按dex顺序串行调用, 可能在不同的工作线程上,
+    /// 调用结束后该dex的数据即被释放, 内存只和同时处理的dex数量有关
+    /// @param options 使用其中的threads
+    /// @param visitor 每个dex调用一次, 无法读取的dex被跳过
+    void VisitDexMembers(const DexOptions& options,
+                         const std::function<void(const DexMembers&)>& visitor) const;
+
+    /// @brief 扫描所有dex的代码, 提取调用的方法、访问的字段和加载的字符串常量
+    ///
+    /// 用libdexfile加载并校验dex, 每个dex的类分配到多个工作线程上,
+    /// 只解码invoke-*、const-string和字段访问指令
+    /// @param options 使用其中的threads和instructionBudget
+    /// @return 永远不会返回nullptr
+    std::unique_ptr<InvokeResult> ParseInvokes(const DexOptions& options = DexOptions()) const;
+
+    /// @brief 列出apk中所有的dex文件
+    std::vector<aapt::io::IFile*> FindDexFiles() const;
+
+    /// @brief 用libdexfile加载内存中的dex, 不拷贝数据
+    /// @param verify 是否校验dex结构, 需要遍历代码时应该校验
+    /// @return 不是合法dex返回nullptr
+    static std::unique_ptr<const art::DexFile> OpenDexFile(const uint8_t* base, size_t size,
+                                                           const std::string& location,
+                                                           bool verify = false);
 
     /// @brief 执行所有的任务, 并返回json
+    /// @param options dex解析选项
+    /// @param stringOptions 资源字符串池解码选项
     /// @return 某个任务失败返回nullptr
-    std::unique_ptr<nlohmann::json> DoAllTasks() const;
-
-    // 删除字符串中的\r \n \t 空格
-    static std::string TrimString(std::string str) {
-        str.erase(std::remove(str.begin(), str.end(), '\r'), str.end());
-        str.erase(std::remove(str.begin(), str.end(), '\n'), str.end());
-        str.erase(std::remove(str.begin(), str.end(), '\t'), str.end());
-        return str;
+    std::unique_ptr<nlohmann::json> DoAllTasks(
+            const DexOptions& options = DexOptions(),
+            const StringOptions& stringOptions = StringOptions()) const;
+
+    // 删除字符串中的\r \n \t, 没有需要删除的字符时直接返回str, 不拷贝;
+    // 否则把删除后的结果放到buffer中, 返回指向buffer的视图
+    static std::string_view TrimString(std::string_view str, std::string* buffer) {
+        size_t pos = FindTrimChar(str.data(), str.size());
+        if (pos == str.size()) {
+            return str;
+        }
+        buffer->assign(str.data(), str.size());
+        buffer->resize(TrimInPlace(buffer->data() + pos, buffer->size() - pos) + pos);
+        return *buffer;
+    }
+
+    // 把dex中的MUTF-8字符串转换为UTF-8, 并删除\r \n \t;
+    // 全部是ASCII且不需要删除时直接返回str, 否则结果放到buffer中
+    static std::string_view DecodeDexString(std::string_view str, std::string* buffer) {
+        if (IsAscii(str.data(), str.size())) {
+            return TrimString(str, buffer);
+        }
+        buffer->clear();
+        MutfToUtf8(str, buffer);
+        TrimString(buffer);
+        return *buffer;
+    }
+
+    // 原地删除字符串中的\r \n \t
+    static void TrimString(std::string* str) {
+        size_t pos = FindTrimChar(str->data(), str->size());
+        if (pos != str->size()) {
+            str->resize(TrimInPlace(str->data() + pos, str->size() - pos) + pos);
+        }
     }
 };
 
@@ -0,0 +1,226 @@
+#include "ArscTable.h"
+
+#include <androidfw/ResourceUtils.h>
+
+#include <algorithm>
+
+namespace apkparser {
+
+// 和ResTable::resolveReference的上限一致
+constexpr static int kMaxReferenceDepth = 20;
+
+std::unique_ptr<ArscTable> ArscTable::Load(std::unique_ptr<aapt::io::IData> data,
+                                           std::string* error) {
+    std::unique_ptr<const android::LoadedArsc> arsc =
+            android::LoadedArsc::Load(data->data(), data->size());
+    if (arsc == nullptr || arsc->GetStringPool() == nullptr) {
+        *error = "failed to load resources.arsc";
+        return {};
+    }
+    return std::unique_ptr<ArscTable>(new ArscTable(std::move(data), std::move(arsc)));
+}
+
+bool ArscTable::GetStringPoolView(StringPoolView* view, std::string* error) const {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(data_->data());
+    size_t size = data_->size();
+    const auto* header = reinterpret_cast<const android::ResTable_header*>(data);
+    // Load已经检查过表头, 这里只需要按块头遍历子块
+    size_t end = std::min<size_t>(dtohl(header->header.size), size);
+    size_t pos = dtohs(header->header.headerSize);
+    while (pos + sizeof(android::ResChunk_header) <= end) {
+        const auto* chunk = reinterpret_cast<const android::ResChunk_header*>(data + pos);
+        size_t chunkSize = dtohl(chunk->size);
+        if (chunkSize < sizeof(android::ResChunk_header) || chunkSize > end - pos) {
+            break;
+        }
+        // 和LoadedArsc一样, 第一个字符串池块是全局字符串池
+        if (dtohs(chunk->type) == android::RES_STRING_POOL_TYPE) {
+            return view->Open(chunk, chunkSize, error);
+        }
+        pos += chunkSize;
+    }
+    *error = "global string pool not found";
+    return false;
+}
+
+std::set<std::string> ArscTable::GetLocales() const {
+    std::set<std::string> locales;
+    // LoadedPackage只收集非默认的语言
+    locales.insert("");
+    for (const auto& package : arsc_->GetPackages()) {
+        package->CollectLocales(/*canonicalize=*/false, &locales);
+    }
+    return locales;
+}
+
+bool ArscTable::CollectValues(uint32_t resid, std::vector<ConfigValue>* values,
+                              std::string* error) const {
+    const android::LoadedPackage* package = arsc_->GetPackageById(android::get_package_id(resid));
+    if (package == nullptr) {
+        *error = "resource`s package not exist";
+        return false;
+    }
+    const android::TypeSpec* typeSpec =
+            android::get_type_id(resid) != 0
+                    ? package->GetTypeSpecByTypeIndex(android::get_type_id(resid) - 1)
+                    : nullptr;
+    if (typeSpec == nullptr) {
+        *error = "resource type does not exist";
+        return false;
+    }
+    const uint16_t entryIndex = android::get_entry_id(resid);
+    for (const auto& typeEntry : typeSpec->type_entries) {
+        // 该配置下没有这个条目时跳过
+        auto entry = android::LoadedPackage::GetEntry(typeEntry.type, entryIndex);
+        if (!entry.has_value() || *entry == nullptr) {
+            continue;
+        }
+        ConfigValue configValue;
+        configValue.config = &typeEntry.config;
+        const android::ResTable_entry* resEntry = entry->unsafe_ptr();
+        // 值紧跟在ResTable_entry之后, 不能超出所在的type块
+        const uint8_t* chunk = reinterpret_cast<const uint8_t*>(typeEntry.type.unsafe_ptr());
+        const uint8_t* valueData =
+                reinterpret_cast<const uint8_t*>(resEntry) + dtohs(resEntry->size);
+        if ((dtohs(resEntry->flags) & android::ResTable_entry::FLAG_COMPLEX) != 0) {
+            // bag(style、plurals等)不是单个值
+            configValue.error = "attribute is not a string value";
+        } else if (valueData + sizeof(android::Res_value) >
+                   chunk + dtohl(typeEntry.type->header.size)) {
+            configValue.error = "resource entry out of bounds";
+        } else {
+            const auto* value = reinterpret_cast<const android::Res_value*>(valueData);
+            configValue.value.size = dtohs(value->size);
+            configValue.value.res0 = value->res0;
+            configValue.value.dataType = value->dataType;
+            configValue.value.data = dtohl(value->data);
+        }
+        values->push_back(configValue);
+    }
+    return true;
+}
+
+bool ArscTable::SelectValue(const std::vector<ConfigValue>& values,
+                            const android::ResTable_config& config, android::Res_value* value,
+                            std::string* error) {
+    // 和AssetManager2一样: 先在匹配的配置中选出最好的, 选中的是bag或越界时才失败
+    const ConfigValue* best = nullptr;
+    for (const ConfigValue& candidate : values) {
+        if (!candidate.config->match(config) ||
+            (best != nullptr && !candidate.config->isBetterThan(*best->config, &config))) {
+            continue;
+        }
+        best = &candidate;
+    }
+    if (best == nullptr) {
+        *error = "attribute value reference does not exist";
+        return false;
+    }
+    if (best->error != nullptr) {
+        *error = best->error;
+        return false;
+    }
+    *value = best->value;
+    return true;
+}
+
+bool ArscTable::FindValue(uint32_t resid, const android::ResTable_config& config,
+                          android::Res_value* value, std::string* error) const {
+    std::vector<ConfigValue> values;
+    return CollectValues(resid, &values, error) && SelectValue(values, config, value, error);
+}
+
+bool ArscTable::FollowReferences(const android::ResTable_config& config, int depth,
+                                 android::Res_value* value, std::string* error) const {
+    while (value->dataType == android::Res_value::TYPE_REFERENCE ||
+           value->dataType == android::Res_value::TYPE_DYNAMIC_REFERENCE) {
+        if (value->data == 0) {
+            *error = "attribute value reference does not exist";
+            return false;
+        }
+        if (depth >= kMaxReferenceDepth) {
+            *error = "too many levels of resource references";
+            return false;
+        }
+        if (!FindValue(value->data, config, value, error)) {
+            return false;
+        }
+        depth++;
+    }
+    return true;
+}
+
+bool ArscTable::Resolve(uint32_t resid, const android::ResTable_config& config,
+                        android::Res_value* value, std::string* error) const {
+    return FindValue(resid, config, value, error) &&
+           FollowReferences(config, /*depth=*/1, value, error);
+}
+
+bool ArscTable::GetString(const android::Res_value& value, std::string* out,
+                          std::string* error) const {
+    if (value.dataType != android::Res_value::TYPE_STRING) {
+        *error = "attribute is not a string value";
+        return false;
+    }
+    auto str = GetStringPool()->string8ObjectAt(value.data);
+    if (!str.has_value()) {
+        *error = "string index out of range";
+        return false;
+    }
+    out->assign(str.value().string(), str.value().size());
+    return true;
+}
+
+bool ArscTable::ResolveString(uint32_t resid, const android::ResTable_config& config,
+                              std::string* out, std::string* error) const {
+    android::Res_value value;
+    return Resolve(resid, config, &value, error) && GetString(value, out, error);
+}
+
+bool ArscTable::ResolveStringPerLocale(uint32_t resid, const android::ResTable_config& config,
+                                       const std::set<std::string>& locales,
+                                       std::map<std::string, std::string>* out,
+                                       std::string* error) const {
+    // 条目所在type的所有配置只遍历一次, 之后每种语言只在收集到的值中选择
+    std::vector<ConfigValue> values;
+    if (!CollectValues(resid, &values, error)) {
+        return false;
+    }
+    for (const std::string& locale : locales) {
+        // 和AssetManager::setConfiguration一致, 空字符串表示清除语言和地区
+        android::ResTable_config localeConfig = config;
+        localeConfig.setBcp47Locale(locale.c_str());
+        android::Res_value value;
+        std::string str;
+        std::string ignored;
+        // 值是引用时按这种语言的配置继续解析
+        if (SelectValue(values, localeConfig, &value, &ignored) &&
+            FollowReferences(localeConfig, /*depth=*/1, &value, &ignored) &&
+            GetString(value, &str, &ignored)) {
+            (*out)[locale] = std::move(str);
+        }
+    }
+    return true;
+}
+
+std::vector<uint32_t> ArscTable::CollectResourceIds(size_t limit) const {
+    std::vector<uint32_t> ids;
+    for (const auto& package : arsc_->GetPackages()) {
+        for (uint32_t typeIndex = 0; typeIndex < 0xff; typeIndex++) {
+            const android::TypeSpec* typeSpec = package->GetTypeSpecByTypeIndex(typeIndex);
+            if (typeSpec == nullptr) {
+                continue;
+            }
+            uint32_t count = dtohl(typeSpec->type_spec->entryCount);
+            for (uint32_t entry = 0; entry < count && entry <= 0xffff; entry++) {
+                if (ids.size() >= limit) {
+                    return ids;
+                }
+                ids.push_back(android::make_resid(package->GetPackageId(), typeIndex + 1, entry));
+            }
+        }
+    }
+    return ids;
+}
+
+} // namespace apkparser
@@ -0,0 +1,110 @@
+#ifndef APKPARSER_ARSC_TABLE_H
+#define APKPARSER_ARSC_TABLE_H
+
+#include <androidfw/LoadedArsc.h>
+#include <io/Data.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "StringPool.h"
+
+namespace apkparser {
+
+/// @brief 基于LoadedArsc的只读资源表
+///
+/// 直接引用resources.arsc的数据, 加载时只建立package和type的索引, 不像旧的ResTable那样
+/// 为每个package构建完整的表. 查找时按传入的配置选择最匹配的值, 不保存当前配置,
+/// 切换语言不需要重建任何缓存, 可以在多个线程上同时查找
+class ArscTable {
+private:
+    std::unique_ptr<aapt::io::IData> data_;
+    std::unique_ptr<const android::LoadedArsc> arsc_;
+
+    ArscTable(std::unique_ptr<aapt::io::IData> data,
+              std::unique_ptr<const android::LoadedArsc> arsc)
+          : data_(std::move(data)), arsc_(std::move(arsc)){};
+
+    /// @brief 某个配置下资源条目的值
+    struct ConfigValue {
+        const android::ResTable_config* config = nullptr;
+        android::Res_value value{};
+        /// 条目是bag或越界时不为空, 该配置被选为最匹配的配置时返回这个错误
+        const char* error = nullptr;
+    };
+
+    /// @brief 按type中配置的顺序收集resid在每个配置下的值, 没有该条目的配置不收集
+    /// @return package或type不存在返回false
+    bool CollectValues(uint32_t resid, std::vector<ConfigValue>* values,
+                       std::string* error) const;
+
+    /// @brief 在收集到的值中选择和config最匹配的值, 与AssetManager2的选择规则一致
+    static bool SelectValue(const std::vector<ConfigValue>& values,
+                            const android::ResTable_config& config, android::Res_value* value,
+                            std::string* error);
+
+    /// @brief 查找resid在config下最匹配的值, 不解析引用
+    bool FindValue(uint32_t resid, const android::ResTable_config& config,
+                   android::Res_value* value, std::string* error) const;
+
+    /// @brief value是引用时按config继续解析, 直到得到不是引用的值
+    /// @param depth 已经查找的次数
+    bool FollowReferences(const android::ResTable_config& config, int depth,
+                          android::Res_value* value, std::string* error) const;
+
+    /// @brief 字符串类型的值转换为UTF-8
+    bool GetString(const android::Res_value& value, std::string* out, std::string* error) const;
+
+public:
+    /// @param data resources.arsc的数据, 表持有它, 通常是apk映像中的视图
+    /// @return 数据损坏返回nullptr
+    static std::unique_ptr<ArscTable> Load(std::unique_ptr<aapt::io::IData> data,
+                                           std::string* error);
+
+    /// @brief 全局字符串池, 字符串类型的值都在其中
+    const android::ResStringPool* GetStringPool() const { return arsc_->GetStringPool(); }
+
+    /// @brief 全局字符串池的原始数据视图, 用于批量解码所有字符串
+    /// @return 找不到字符串池块或块头越界返回false
+    bool GetStringPoolView(StringPoolView* view, std::string* error) const;
+
+    const android::LoadedArsc& GetLoadedArsc() const { return *arsc_; }
+
+    /// @brief 表引用的resources.arsc数据
+    const aapt::io::IData& GetData() const { return *data_; }
+
+    /// @brief 所有配置中出现的语言(BCP 47), 包括表示默认语言的空字符串
+    std::set<std::string> GetLocales() const;
+
+    /// @brief 按config选择最匹配的值并解析引用, 与ResTable::getResource+resolveReference一致
+    /// @return 资源不存在或引用无法解析返回false
+    bool Resolve(uint32_t resid, const android::ResTable_config& config, android::Res_value* value,
+                 std::string* error) const;
+
+    /// @brief 同Resolve, 值必须是字符串, 输出UTF-8
+    bool ResolveString(uint32_t resid, const android::ResTable_config& config, std::string* out,
+                       std::string* error) const;
+
+    /// @brief 解析resid在每种语言下的字符串值
+    ///
+    /// 只遍历一次条目所在type的所有配置, 收集有这个条目的配置和值, 再在内存中为每种语言
+    /// 选择最匹配的值. 结果和对每种语言分别调用ResolveString一致
+    /// @param config 语言和地区之外的配置
+    /// @param locales BCP 47语言, 空字符串表示默认语言
+    /// @param out 能解析为字符串的语言和对应的值, 解析失败的语言不输出
+    /// @return package或type不存在返回false
+    bool ResolveStringPerLocale(uint32_t resid, const android::ResTable_config& config,
+                                const std::set<std::string>& locales,
+                                std::map<std::string, std::string>* out,
+                                std::string* error) const;
+
+    /// @brief 按package、type、entry的顺序列出最多limit个资源id, 用于基准测试
+    std::vector<uint32_t> CollectResourceIds(size_t limit) const;
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_ARSC_TABLE_H
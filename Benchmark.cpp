@@ -0,0 +1,402 @@
+#include "Benchmark.h"
+
+#include <android-base/stringprintf.h>
+#include <dex/dex_file-inl.h>
+#include <dex/dex_file.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+
+#include "Inflate.h"
+
+using ::android::base::StringPrintf;
+
+namespace apkparser {
+
+/// @brief 原始的三遍std::remove实现, 作为对比基准
+static std::string LegacyTrimString(std::string str) {
+    str.erase(std::remove(str.begin(), str.end(), '\r'), str.end());
+    str.erase(std::remove(str.begin(), str.end(), '\n'), str.end());
+    str.erase(std::remove(str.begin(), str.end(), '\t'), str.end());
+    return str;
+}
+
+/// @brief 收集资源字符串池和所有dex中未经处理的字符串
+static std::vector<std::string> CollectStrings(const Apk& apk) {
+    std::vector<std::string> corpus;
+    const ArscTable* table = apk.GetArscTable();
+    const android::ResStringPool* pool = table != nullptr ? table->GetStringPool() : nullptr;
+    if (pool != nullptr && pool->getError() == android::NO_ERROR) {
+        for (size_t i = 0; i < pool->size(); i++) {
+            auto str = pool->string8ObjectAt(i);
+            if (str.has_value()) {
+                corpus.push_back(str.value().string());
+            }
+        }
+    }
+    for (aapt::io::IFile* file : apk.FindDexFiles()) {
+        std::unique_ptr<aapt::io::IData> data = file->OpenAsData();
+        if (data == nullptr) {
+            continue;
+        }
+        std::unique_ptr<const art::DexFile> dexFile =
+                Apk::OpenDexFile(reinterpret_cast<const uint8_t*>(data->data()), data->size(),
+                                 file->GetSource().path);
+        if (dexFile == nullptr) {
+            continue;
+        }
+        for (uint32_t i = 0; i < dexFile->NumStringIds(); ++i) {
+            corpus.push_back(
+                    dexFile->GetStringData(dexFile->GetStringId(art::dex::StringIndex(i))));
+        }
+    }
+    return corpus;
+}
+
+/// @brief 重复执行run直到累计耗时超过200ms
+/// @return 每轮的平均耗时, 单位纳秒
+static double Measure(const std::function<size_t()>& run, size_t* checksum) {
+    using Clock = std::chrono::steady_clock;
+    size_t rounds = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    do {
+        *checksum = run();
+        rounds++;
+        elapsed = Clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(200));
+    return std::chrono::duration<double, std::nano>(elapsed).count() / rounds;
+}
+
+static bool BenchmarkTrimString(const std::vector<std::string>& corpus) {
+    size_t bytes = 0;
+    size_t dirty = 0;
+    for (const auto& str : corpus) {
+        bytes += str.size();
+        dirty += FindTrimChar(str.data(), str.size()) != str.size();
+    }
+    std::cout << StringPrintf("TrimString: %zu strings, %zu bytes, %zu need trimming",
+                              corpus.size(), bytes, dirty)
+              << std::endl;
+
+    size_t expected = 0;
+    double baseline = Measure(
+            [&]() {
+                size_t sum = 0;
+                for (const auto& str : corpus) {
+                    sum += LegacyTrimString(str).size();
+                }
+                return sum;
+            },
+            &expected);
+    std::cout << StringPrintf("  %-8s %10.1f ns/string %8.1f MB/s", "legacy",
+                              baseline / corpus.size(), bytes * 1e3 / baseline)
+              << std::endl;
+
+    bool ok = true;
+    SimdLevel saved = GetSimdLevel();
+    for (SimdLevel level : {SimdLevel::kScalar, SimdLevel::kSse2, SimdLevel::kAvx2}) {
+        if (level > DetectSimdLevel()) {
+            continue;
+        }
+        SetSimdLevel(level);
+        size_t checksum = 0;
+        std::string buffer;
+        double cost = Measure(
+                [&]() {
+                    size_t sum = 0;
+                    for (const auto& str : corpus) {
+                        sum += Apk::TrimString(str, &buffer).size();
+                    }
+                    return sum;
+                },
+                &checksum);
+        ok &= checksum == expected;
+        std::cout << StringPrintf("  %-8s %10.1f ns/string %8.1f MB/s  x%.2f%s",
+                                  SimdLevelName(level), cost / corpus.size(), bytes * 1e3 / cost,
+                                  baseline / cost, checksum == expected ? "" : "  MISMATCH")
+                  << std::endl;
+    }
+    SetSimdLevel(saved);
+    return ok;
+}
+
+/// @brief 用apk中所有deflate压缩的条目对比各个解码器, 输出用CRC32校验
+static bool BenchmarkInflate(const ZipImage& image) {
+    std::vector<const ZipEntryInfo*> entries;
+    uint64_t bytes = 0;
+    for (const ZipEntryInfo& entry : image.Entries()) {
+        if (entry.method == kZipMethodDeflated) {
+            entries.push_back(&entry);
+            bytes += entry.uncompressedSize;
+        }
+    }
+    if (entries.empty()) {
+        return true;
+    }
+    std::cout << StringPrintf("Inflate: %zu deflated entries, %llu bytes", entries.size(),
+                              static_cast<unsigned long long>(bytes))
+              << std::endl;
+    bool ok = true;
+    InflateBackend saved = GetInflateBackend();
+    for (InflateBackend backend : {InflateBackend::kZlib, InflateBackend::kOneShot}) {
+        SetInflateBackend(backend);
+        size_t failures = 0;
+        double cost = Measure(
+                [&]() {
+                    failures = 0;
+                    for (const ZipEntryInfo* entry : entries) {
+                        std::unique_ptr<aapt::io::IData> data = image.OpenEntry(*entry);
+                        if (data == nullptr ||
+                            crc32(0, reinterpret_cast<const Bytef*>(data->data()),
+                                  data->size()) != entry->crc32) {
+                            failures++;
+                        }
+                    }
+                    return failures;
+                },
+                &failures);
+        ok &= failures == 0;
+        std::cout << StringPrintf("  %-8s %10.3f ms %8.1f MB/s%s", InflateBackendName(backend),
+                                  cost / 1e6, bytes * 1e3 / cost,
+                                  failures == 0 ? "" : "  CRC MISMATCH")
+                  << std::endl;
+    }
+    SetInflateBackend(saved);
+    return ok;
+}
+
+/// @brief 对比旧的ResTable和ArscTable: 加载、遍历全局字符串池、在所有语言下解析资源
+static bool BenchmarkResources(const ZipImage& image) {
+    const ZipEntryInfo* entry = image.Find(kApkResourceTablePath);
+    if (entry == nullptr) {
+        return true;
+    }
+    // 只读取一次, 两种资源表都使用这份数据
+    std::unique_ptr<aapt::io::IData> arscData = image.OpenEntry(*entry);
+    std::string error;
+    std::unique_ptr<ArscTable> table;
+    if (arscData != nullptr) {
+        table = ArscTable::Load(std::move(arscData), &error);
+    }
+    if (table == nullptr) {
+        std::cerr << "failed to load resources.arsc" << std::endl;
+        return false;
+    }
+    const aapt::io::IData* data = &table->GetData();
+    std::vector<uint32_t> ids = table->CollectResourceIds(2000);
+    std::set<std::string> locales = table->GetLocales();
+    std::cout << StringPrintf("Resources: %zu bytes, %zu locales, %zu resources sampled",
+                              data->size(), locales.size(), ids.size())
+              << std::endl;
+    std::vector<android::ResTable_config> configs;
+    for (const std::string& locale : locales) {
+        android::ResTable_config config;
+        memset(&config, 0, sizeof(config));
+        config.sdkVersion = 10000;
+        config.setBcp47Locale(locale.c_str());
+        configs.push_back(config);
+    }
+    auto poolChecksum = [](const android::ResStringPool* pool) {
+        size_t sum = 0;
+        for (size_t i = 0; pool != nullptr && i < pool->size(); i++) {
+            auto str = pool->string8ObjectAt(i);
+            sum += str.has_value() ? str.value().size() : 0;
+        }
+        return sum;
+    };
+
+    size_t legacyChecksum = 0;
+    double legacyLoad = Measure(
+            [&]() {
+                android::ResTable resTable;
+                resTable.add(data->data(), data->size(), -1, /*copyData=*/false);
+                return static_cast<size_t>(resTable.getTableCount());
+            },
+            &legacyChecksum);
+    double arscLoad = Measure(
+            [&]() {
+                auto arsc = android::LoadedArsc::Load(data->data(), data->size());
+                return arsc != nullptr ? arsc->GetPackages().size() : 0;
+            },
+            &legacyChecksum);
+
+    android::ResTable resTable;
+    resTable.add(data->data(), data->size(), -1, /*copyData=*/false);
+    size_t expected = 0;
+    double legacyStrings = Measure(
+            [&]() {
+                return resTable.getTableCount() > 0 ? poolChecksum(resTable.getTableStringBlock(0))
+                                                    : 0;
+            },
+            &expected);
+    size_t checksum = 0;
+    double arscStrings = Measure([&]() { return poolChecksum(table->GetStringPool()); }, &checksum);
+    bool ok = checksum == expected;
+
+    double legacyResolve = Measure(
+            [&]() {
+                size_t resolved = 0;
+                for (const android::ResTable_config& config : configs) {
+                    resTable.setParameters(&config);
+                    for (uint32_t id : ids) {
+                        android::Res_value value;
+                        ssize_t block = resTable.getResource(id, &value, false);
+                        resolved += block >= 0 && resTable.resolveReference(&value, block) >= 0
+                                ? value.dataType + value.data
+                                : 0;
+                    }
+                }
+                return resolved;
+            },
+            &expected);
+    double arscResolve = Measure(
+            [&]() {
+                size_t resolved = 0;
+                std::string ignored;
+                for (const android::ResTable_config& config : configs) {
+                    for (uint32_t id : ids) {
+                        android::Res_value value;
+                        resolved += table->Resolve(id, config, &value, &ignored)
+                                ? value.dataType + value.data
+                                : 0;
+                    }
+                }
+                return resolved;
+            },
+            &checksum);
+    ok &= checksum == expected;
+    std::cout << StringPrintf("  %-8s load %8.3f ms  strings %8.3f ms  resolve %8.3f ms",
+                              "ResTable", legacyLoad / 1e6, legacyStrings / 1e6,
+                              legacyResolve / 1e6)
+              << std::endl;
+    std::cout << StringPrintf("  %-8s load %8.3f ms  strings %8.3f ms  resolve %8.3f ms%s",
+                              "Arsc", arscLoad / 1e6, arscStrings / 1e6, arscResolve / 1e6,
+                              ok ? "" : "  MISMATCH")
+              << std::endl;
+
+    // 每个资源在所有语言下的字符串(应用名的解析方式): 逐个语言查找 对比 收集一次后按语言选择
+    double perConfig = Measure(
+            [&]() {
+                size_t sum = 0;
+                std::string str;
+                std::string ignored;
+                for (uint32_t id : ids) {
+                    for (const android::ResTable_config& config : configs) {
+                        sum += table->ResolveString(id, config, &str, &ignored) ? str.size() : 0;
+                    }
+                }
+                return sum;
+            },
+            &expected);
+    android::ResTable_config base;
+    memset(&base, 0, sizeof(base));
+    base.sdkVersion = 10000;
+    double perLocale = Measure(
+            [&]() {
+                size_t sum = 0;
+                std::map<std::string, std::string> values;
+                std::string ignored;
+                for (uint32_t id : ids) {
+                    values.clear();
+                    table->ResolveStringPerLocale(id, base, locales, &values, &ignored);
+                    for (const auto& value : values) {
+                        sum += value.second.size();
+                    }
+                }
+                return sum;
+            },
+            &checksum);
+    std::cout << StringPrintf("  %-8s per-locale lookup %8.3f ms  one pass %8.3f ms%s", "labels",
+                              perConfig / 1e6, perLocale / 1e6,
+                              checksum == expected ? "" : "  MISMATCH")
+              << std::endl;
+    ok &= checksum == expected;
+    return ok;
+}
+
+/// @brief 对比逐个string8ObjectAt和StringPoolView批量解码全局字符串池, 校验和为UTF-8的总字节数
+static bool BenchmarkStringPool(const Apk& apk) {
+    const ArscTable* table = apk.GetArscTable();
+    if (table == nullptr) {
+        return true;
+    }
+    StringPoolView view;
+    std::string error;
+    if (!table->GetStringPoolView(&view, &error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    if (view.size() == 0) {
+        return true;
+    }
+    const android::ResStringPool* pool = table->GetStringPool();
+    size_t capacity = 0;
+    for (size_t i = 0; i < view.size(); i++) {
+        capacity += view.MaxUtf8Size(i);
+    }
+    std::cout << StringPrintf("StringPool: %zu strings, %s", view.size(),
+                              view.IsUtf8() ? "UTF-8" : "UTF-16")
+              << std::endl;
+
+    size_t expected = 0;
+    double baseline = Measure(
+            [&]() {
+                size_t sum = 0;
+                for (size_t i = 0; i < pool->size(); i++) {
+                    auto str = pool->string8ObjectAt(i);
+                    sum += str.has_value() ? str.value().size() : 0;
+                }
+                return sum;
+            },
+            &expected);
+    std::cout << StringPrintf("  %-8s %10.1f ns/string", "String8", baseline / view.size())
+              << std::endl;
+
+    bool ok = true;
+    std::vector<char> arena(capacity);
+    SimdLevel saved = GetSimdLevel();
+    for (SimdLevel level : {SimdLevel::kScalar, SimdLevel::kSse2, SimdLevel::kAvx2}) {
+        if (level > DetectSimdLevel()) {
+            continue;
+        }
+        SetSimdLevel(level);
+        size_t checksum = 0;
+        double cost = Measure(
+                [&]() {
+                    char* out = arena.data();
+                    for (size_t i = 0; i < view.size(); i++) {
+                        out += view.DecodeUtf8(i, out);
+                    }
+                    return static_cast<size_t>(out - arena.data());
+                },
+                &checksum);
+        ok &= checksum == expected;
+        std::cout << StringPrintf("  %-8s %10.1f ns/string %8.1f MB/s  x%.2f%s",
+                                  SimdLevelName(level), cost / view.size(), checksum * 1e3 / cost,
+                                  baseline / cost, checksum == expected ? "" : "  MISMATCH")
+                  << std::endl;
+    }
+    SetSimdLevel(saved);
+    return ok;
+}
+
+bool RunBenchmarks(const Apk& apk) {
+    std::vector<std::string> corpus = CollectStrings(apk);
+    if (corpus.empty()) {
+        std::cerr << "no strings to benchmark" << std::endl;
+        return false;
+    }
+    bool ok = BenchmarkTrimString(corpus);
+    ok &= BenchmarkInflate(*apk.GetImage());
+    ok &= BenchmarkResources(*apk.GetImage());
+    ok &= BenchmarkStringPool(apk);
+    return ok;
+}
+
+} // namespace apkparser
@@ -0,0 +1,14 @@
+#ifndef APKPARSER_BENCHMARK_H
+#define APKPARSER_BENCHMARK_H
+
+#include "Apk.h"
+
+namespace apkparser {
+
+/// @brief 用apk中真实的资源字符串、dex字符串和压缩条目做微基准测试, 结果输出到stdout
+/// @return 测试失败返回false
+bool RunBenchmarks(const Apk& apk);
+
+} // namespace apkparser
+
+#endif // APKPARSER_BENCHMARK_H
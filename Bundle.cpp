@@ -0,0 +1,214 @@
+#include "Bundle.h"
+#include "Parallel.h"
+
+#include <android-base/unique_fd.h>
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string_view>
+
+namespace apkparser {
+
+constexpr static std::string_view kApkSuffix = ".apk";
+constexpr static std::string_view kSplitsDir = "splits/";
+constexpr static std::string_view kManifestName = "AndroidManifest.xml";
+
+/// 每一项所在的split下标, 按split顺序排列, std::map保证输出顺序稳定
+using OriginMap = std::map<std::string_view, std::vector<uint32_t>>;
+
+static bool StartsWith(std::string_view str, std::string_view prefix) {
+    return str.size() >= prefix.size() && str.compare(0, prefix.size(), prefix) == 0;
+}
+
+static bool IsApkEntry(const ZipEntryInfo& entry) {
+    return entry.name.size() > kApkSuffix.size() &&
+           entry.name.compare(entry.name.size() - kApkSuffix.size(), kApkSuffix.size(),
+                              kApkSuffix) == 0;
+}
+
+/// @brief 去掉目录和.apk后缀
+static std::string_view SplitName(std::string_view entry) {
+    size_t slash = entry.rfind('/');
+    if (slash != std::string_view::npos) {
+        entry.remove_prefix(slash + 1);
+    }
+    return entry.substr(0, entry.size() - kApkSuffix.size());
+}
+
+/// @brief split的排序优先级, base排在最前
+///
+/// .apks的base叫base-master, APKM叫base, xapk以包名命名; 配置split以config.或split_开头,
+/// .apks中的其它split形如base-xxhdpi、feature-master
+static int SplitRank(std::string_view name) {
+    if (name == "base" || name == "base-master") {
+        return 0;
+    }
+    if (!StartsWith(name, "config.") && !StartsWith(name, "split_") &&
+        name.find('-') == std::string_view::npos) {
+        return 1;
+    }
+    return 2;
+}
+
+static void AddOrigins(const std::vector<std::string_view>& items, uint32_t split,
+                       OriginMap* origins) {
+    for (std::string_view item : items) {
+        std::vector<uint32_t>& splits = (*origins)[item];
+        if (splits.empty() || splits.back() != split) {
+            splits.push_back(split);
+        }
+    }
+}
+
+static nlohmann::json OriginsToJson(const OriginMap& origins,
+                                    const std::vector<std::string>& names) {
+    nlohmann::json json = nlohmann::json::object();
+    for (const auto& origin : origins) {
+        nlohmann::json& splits = json[std::string(origin.first)];
+        splits = nlohmann::json::array();
+        for (uint32_t split : origin.second) {
+            splits.push_back(names[split]);
+        }
+    }
+    return json;
+}
+
+bool ApkBundle::IsBundle(const ZipImage& image) {
+    if (image.Find(kManifestName) != nullptr) {
+        return false;
+    }
+    return std::any_of(image.Entries().begin(), image.Entries().end(), IsApkEntry);
+}
+
+std::unique_ptr<ApkBundle> ApkBundle::LoadFromPath(const std::string& path, size_t threads) {
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        std::cerr << "failed to open " << path << ": " << strerror(errno) << std::endl;
+        return {};
+    }
+    return LoadFromFd(fd.get(), path, threads);
+}
+
+std::unique_ptr<ApkBundle> ApkBundle::LoadFromFd(int fd, const std::string& name,
+                                                 size_t threads) {
+    std::string error;
+    std::shared_ptr<ZipImage> image = ZipImage::OpenFd(fd, name, &error);
+    if (!image) {
+        std::cerr << "failed opening zip: " << error << std::endl;
+        return {};
+    }
+    return LoadFromImage(std::move(image), threads);
+}
+
+std::unique_ptr<ApkBundle> ApkBundle::LoadFromImage(std::shared_ptr<ZipImage> image,
+                                                    size_t threads) {
+    if (!IsBundle(*image)) {
+        std::cerr << "not an apk bundle: " << image->GetPath() << std::endl;
+        return {};
+    }
+    bool hasSplitsDir = false;
+    for (const ZipEntryInfo& entry : image->Entries()) {
+        hasSplitsDir |= IsApkEntry(entry) && StartsWith(entry.name, kSplitsDir);
+    }
+    std::vector<const ZipEntryInfo*> entries;
+    for (const ZipEntryInfo& entry : image->Entries()) {
+        if (IsApkEntry(entry) && (!hasSplitsDir || StartsWith(entry.name, kSplitsDir))) {
+            entries.push_back(&entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const ZipEntryInfo* left, const ZipEntryInfo* right) {
+                  int leftRank = SplitRank(SplitName(left->name));
+                  int rightRank = SplitRank(SplitName(right->name));
+                  return leftRank != rightRank ? leftRank < rightRank : left->name < right->name;
+              });
+    std::vector<Split> splits(entries.size());
+    std::atomic<bool> failed(false);
+    ParallelFor(entries.size(), threads, [&](size_t index, size_t) {
+        const ZipEntryInfo& entry = *entries[index];
+        Split& split = splits[index];
+        split.name = std::string(SplitName(entry.name));
+        split.entry = std::string(entry.name);
+        // stored的内层apk直接引用外层映像, 不拷贝
+        std::unique_ptr<aapt::io::IData> data = image->OpenEntry(entry);
+        if (data) {
+            split.apk =
+                    Apk::LoadApkFromData(std::move(data), image->GetPath() + "!/" + split.entry);
+        }
+        if (!split.apk) {
+            std::cerr << "failed loading split " << split.entry << std::endl;
+            failed = true;
+        }
+    });
+    if (failed) {
+        return {};
+    }
+    return std::make_unique<ApkBundle>(std::move(image), std::move(splits));
+}
+
+std::unique_ptr<nlohmann::json> ApkBundle::DoAllTasks(const DexOptions& options,
+                                                      const StringOptions& stringOptions) const {
+    struct SplitOutput {
+        std::unique_ptr<std::pair<std::string, std::map<std::string, std::string>>> manifest;
+        std::unique_ptr<ResourceStrings> strings;
+        std::unique_ptr<DexResult> dexes;
+    };
+    std::vector<SplitOutput> outputs(splits_.size());
+    std::atomic<bool> failed(false);
+    // split并行时每个split内部串行, 只有一个工作线程时split内部使用全部线程,
+    // 总线程数不超过options.threads
+    size_t workers = ResolveWorkerCount(options.threads, splits_.size());
+    DexOptions splitOptions = options;
+    StringOptions splitStringOptions = stringOptions;
+    if (workers > 1) {
+        splitOptions.threads = 1;
+        splitOptions.inflateThreads = 1;
+        splitStringOptions.threads = 1;
+    }
+    ParallelFor(splits_.size(), workers, [&](size_t index, size_t) {
+        const Apk& apk = *splits_[index].apk;
+        SplitOutput& output = outputs[index];
+        output.manifest = apk.GetManifest();
+        output.strings = apk.GetStrings(splitStringOptions);
+        output.dexes = apk.ParseDexes(splitOptions);
+        if (!output.manifest || !output.strings || !output.dexes) {
+            std::cerr << "parse split " << splits_[index].entry << " failed" << std::endl;
+            failed = true;
+        }
+    });
+    if (failed) {
+        return {};
+    }
+    // 按split顺序合并, 合并表中的视图指向各split的结果
+    std::vector<std::string> names;
+    nlohmann::json manifests = nlohmann::json::object();
+    std::map<std::string, std::string> displayNames;
+    OriginMap strings, classes, dexStrings;
+    for (uint32_t i = 0; i < outputs.size(); i++) {
+        const SplitOutput& output = outputs[i];
+        names.push_back(splits_[i].name);
+        manifests[splits_[i].name] = output.manifest->first;
+        displayNames.insert(output.manifest->second.begin(), output.manifest->second.end());
+        AddOrigins(output.strings->Views(), i, &strings);
+        AddOrigins(output.dexes->classes.Entries(), i, &classes);
+        AddOrigins(output.dexes->strings.Entries(), i, &dexStrings);
+    }
+    std::unique_ptr<nlohmann::json> result(new nlohmann::json());
+    (*result)["splits"] = names;
+    (*result)["manifests"] = std::move(manifests);
+    (*result)["display_names"] = displayNames;
+    nlohmann::json resStrings;
+    resStrings["strings"] = OriginsToJson(strings, names);
+    (*result)["resources_arsc"] = std::move(resStrings);
+    (*result)["dex_classes"] = OriginsToJson(classes, names);
+    (*result)["dex_strings"] = OriginsToJson(dexStrings, names);
+    return result;
+}
+
+} // namespace apkparser
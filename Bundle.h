@@ -0,0 +1,69 @@
+#ifndef APKPARSER_BUNDLE_H
+#define APKPARSER_BUNDLE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Apk.h"
+
+namespace apkparser {
+
+/// @brief 包含base和split apk的外层zip: bundletool的.apks、.xapk、APKM
+///
+/// 内层apk直接从外层映像打开: stored的内层apk是外层映像中的视图, deflated的解压到内存,
+/// 不写临时文件. base排在第一个, 其余split按条目名排序
+class ApkBundle {
+public:
+    struct Split {
+        /// split名称, 即去掉目录和.apk后缀的条目名, 如 base-master、config.arm64_v8a
+        std::string name;
+        /// 在外层zip中的条目名
+        std::string entry;
+        std::unique_ptr<Apk> apk;
+    };
+
+private:
+    std::shared_ptr<ZipImage> image_;
+    std::vector<Split> splits_;
+
+public:
+    ApkBundle(std::shared_ptr<ZipImage> image, std::vector<Split> splits)
+          : image_(std::move(image)), splits_(std::move(splits)){};
+
+    /// @brief 外层zip根目录没有AndroidManifest.xml并且包含.apk条目时认为是bundle
+    static bool IsBundle(const ZipImage& image);
+
+    /// @brief 打开bundle并并行加载所有split
+    ///
+    /// .apks中有splits/目录时只使用其中的apk, 忽略standalones/等备选apk
+    /// @param threads 加载split的线程数, 0表示使用cpu核数
+    /// @return 不是bundle或任意split加载失败返回nullptr
+    static std::unique_ptr<ApkBundle> LoadFromPath(const std::string& path, size_t threads = 1);
+
+    /// @brief 同LoadFromPath, 从已打开的fd读取, 不接管fd
+    static std::unique_ptr<ApkBundle> LoadFromFd(int fd, const std::string& name,
+                                                 size_t threads = 1);
+
+    /// @brief 同LoadFromPath, 使用已打开的映像
+    static std::unique_ptr<ApkBundle> LoadFromImage(std::shared_ptr<ZipImage> image,
+                                                    size_t threads = 1);
+
+    const std::vector<Split>& GetSplits() const { return splits_; }
+
+    /// @brief 并行解析所有split的manifest、资源字符串和dex, 合并成一个json
+    ///
+    /// manifests按split名称分别保存; display_names按split顺序合并, 同一语言以先出现的为准;
+    /// 资源字符串、dex类名和dex字符串合并去重, 每一项记录出现在哪些split中
+    /// @param options dex解析选项, threads同时作为并行解析split的线程数. 多个split并行时
+    ///                每个split内部的dex解析和字符串解码都是单线程, 总线程数不超过threads
+    /// @param stringOptions 各split资源字符串池的解码选项
+    /// @return 失败返回nullptr
+    std::unique_ptr<nlohmann::json> DoAllTasks(
+            const DexOptions& options = DexOptions(),
+            const StringOptions& stringOptions = StringOptions()) const;
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_BUNDLE_H
@@ -0,0 +1,179 @@
+#include "DexCache.h"
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <io/Data.h>
+#include <utils/FileMap.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include "DexReader.h"
+
+using ::android::base::StringPrintf;
+
+namespace apkparser {
+
+constexpr static char kCacheMagic[4] = {'A', 'D', 'X', 'C'};
+// 解析逻辑(修剪、编码转换、类名规则)变化时需要增加版本号, 使旧缓存失效
+constexpr static uint32_t kCacheVersion = 1;
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t classCount;
+    uint32_t stringCount;
+    uint64_t blobSize;
+};
+
+std::unique_ptr<DexCache> DexCache::Open(const std::string& dir, DexCacheKey keyMode,
+                                         const ZipImage* image) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "failed to create dex cache dir " << dir << ": " << strerror(errno)
+                  << std::endl;
+        return {};
+    }
+    return std::unique_ptr<DexCache>(new DexCache(dir, keyMode, image));
+}
+
+std::string DexCache::PathForKey(const std::string& key) const {
+    return dir_ + "/" + key + ".dexc";
+}
+
+bool DexCache::ComputeKey(const std::string& entryName, std::string* key) const {
+    const ZipEntryInfo* entry = image_->Find(entryName);
+    if (entry == nullptr) {
+        return false;
+    }
+    if (keyMode_ == DexCacheKey::kEntry) {
+        *key = StringPrintf("e-%08x-%016llx", entry->crc32,
+                            static_cast<unsigned long long>(entry->uncompressedSize));
+        return true;
+    }
+    // 只解压到dex header结束
+    std::string header;
+    if (!image_->ReadPrefix(*entry, sizeof(DexHeader), &header) ||
+        !DexReader::IsDexMagic(reinterpret_cast<const uint8_t*>(header.data()), header.size())) {
+        return false;
+    }
+    DexHeader dexHeader;
+    memcpy(&dexHeader, header.data(), sizeof(DexHeader));
+    *key = StringPrintf("h-%08x-", dexHeader.checksum);
+    for (uint8_t byte : dexHeader.signature) {
+        *key += StringPrintf("%02x", byte);
+    }
+    return true;
+}
+
+bool DexCache::Load(const std::string& key, bool zeroCopy, DexResult* result) const {
+    std::string path = PathForKey(key);
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CacheHeader)) {
+        return false;
+    }
+    android::FileMap map;
+    if (!map.create(path.c_str(), fd.get(), 0, st.st_size, true)) {
+        return false;
+    }
+    const char* base = reinterpret_cast<const char*>(map.getDataPtr());
+    size_t size = map.getDataLength();
+    CacheHeader header;
+    memcpy(&header, base, sizeof(CacheHeader));
+    uint64_t count = static_cast<uint64_t>(header.classCount) + header.stringCount;
+    uint64_t offsetsSize = (count + 1) * sizeof(uint32_t);
+    // 分别和文件大小比较, 相加可能回绕
+    if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+        header.version != kCacheVersion || offsetsSize > size - sizeof(CacheHeader) ||
+        header.blobSize != size - sizeof(CacheHeader) - offsetsSize) {
+        std::cerr << "ignoring corrupt dex cache file " << path << std::endl;
+        return false;
+    }
+    const char* offsets = base + sizeof(CacheHeader);
+    const char* blob = offsets + offsetsSize;
+    // 先校验所有偏移, 避免损坏的缓存只加载了一半
+    uint32_t previous = 0;
+    for (uint64_t i = 0; i <= count; i++) {
+        uint32_t offset;
+        memcpy(&offset, offsets + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (offset < previous || offset > header.blobSize || (i == 0 && offset != 0)) {
+            std::cerr << "ignoring corrupt dex cache file " << path << std::endl;
+            return false;
+        }
+        previous = offset;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t range[2];
+        memcpy(range, offsets + i * sizeof(uint32_t), sizeof(range));
+        std::string_view str(blob + range[0], range[1] - range[0]);
+        StringTable& table = i < header.classCount ? result->classes : result->strings;
+        if (zeroCopy) {
+            table.InternView(str);
+        } else {
+            table.Intern(str);
+        }
+    }
+    if (zeroCopy) {
+        result->buffers.push_back(std::make_unique<aapt::io::MmappedData>(std::move(map)));
+    }
+    return true;
+}
+
+bool DexCache::Store(const std::string& key, const DexResult& result) const {
+    const std::vector<std::string_view>& classes = result.classes.Entries();
+    const std::vector<std::string_view>& strings = result.strings.Entries();
+    uint64_t blobSize = 0;
+    for (const auto& table : {&classes, &strings}) {
+        for (std::string_view str : *table) {
+            blobSize += str.size();
+        }
+    }
+    if (blobSize > UINT32_MAX) {
+        return false;
+    }
+    CacheHeader header;
+    memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.classCount = static_cast<uint32_t>(classes.size());
+    header.stringCount = static_cast<uint32_t>(strings.size());
+    header.blobSize = blobSize;
+
+    std::string content;
+    content.reserve(sizeof(CacheHeader) + (classes.size() + strings.size() + 1) * 4 + blobSize);
+    content.append(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+    uint32_t offset = 0;
+    for (const auto& table : {&classes, &strings}) {
+        for (std::string_view str : *table) {
+            content.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+            offset += static_cast<uint32_t>(str.size());
+        }
+    }
+    content.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    for (const auto& table : {&classes, &strings}) {
+        for (std::string_view str : *table) {
+            content.append(str.data(), str.size());
+        }
+    }
+
+    std::string path = PathForKey(key);
+    std::string tmpPath = StringPrintf("%s.%d.%zx.tmp", path.c_str(), getpid(),
+                                       std::hash<std::thread::id>()(std::this_thread::get_id()));
+    if (!android::base::WriteStringToFile(content, tmpPath) ||
+        rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        std::cerr << "failed to write dex cache file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace apkparser
@@ -0,0 +1,49 @@
+#ifndef APKPARSER_DEX_CACHE_H
+#define APKPARSER_DEX_CACHE_H
+
+#include "Apk.h"
+#include "ZipImage.h"
+
+namespace apkparser {
+
+/// @brief 持久化的dex解析结果缓存, 每个dex一个文件, 可以直接mmap使用
+///
+/// 文件格式(小端):
+///   CacheHeader
+///   uint32_t offsets[classCount + stringCount + 1]  字符串在blob中的起始偏移, 最后一个是blob长度
+///   char blob[]                                       先是所有类名, 然后是所有字符串
+class DexCache {
+private:
+    std::string dir_;
+    DexCacheKey keyMode_;
+    const ZipImage* image_;
+
+    DexCache(const std::string& dir, DexCacheKey keyMode, const ZipImage* image)
+          : dir_(dir), keyMode_(keyMode), image_(image){};
+
+    std::string PathForKey(const std::string& key) const;
+
+public:
+    /// @brief 打开缓存目录, CRC32和dex header从apk的映像中读取
+    /// @param dir 缓存目录, 不存在时创建
+    /// @param image apk映像, 缓存存活期间必须有效
+    /// @return 失败返回nullptr
+    static std::unique_ptr<DexCache> Open(const std::string& dir, DexCacheKey keyMode,
+                                          const ZipImage* image);
+
+    /// @brief 计算zip条目的缓存key, kEntry模式只读中央目录, kHeader模式只解压dex header
+    /// @return 条目不存在或不是dex返回false
+    bool ComputeKey(const std::string& entryName, std::string* key) const;
+
+    /// @brief 读取缓存, 命中时类名和字符串以视图的形式加入result, mmap的缓存文件保存在result中
+    /// @param zeroCopy false时拷贝字符串, 不保留mmap
+    /// @return 未命中或缓存文件损坏返回false
+    bool Load(const std::string& key, bool zeroCopy, DexResult* result) const;
+
+    /// @brief 写入一个dex的解析结果, 先写临时文件再重命名, 多进程并发写入也不会读到半个文件
+    bool Store(const std::string& key, const DexResult& result) const;
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_DEX_CACHE_H
@@ -0,0 +1,246 @@
+#include <dex/class_accessor-inl.h>
+#include <dex/code_item_accessors-inl.h>
+#include <dex/dex_file-inl.h>
+#include <dex/dex_file.h>
+#include <dex/dex_instruction-inl.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "Apk.h"
+#include "Parallel.h"
+
+namespace apkparser {
+
+// 每个方法解码完扣除一次预算, 超大方法在解码过程中每kBudgetChunk条指令也扣除一次
+constexpr static uint32_t kBudgetChunk = 4096;
+
+/// @brief 一个工作线程在一个dex中引用到的下标
+struct DexReferences {
+    std::vector<bool> methods;
+    std::vector<bool> fields;
+    std::vector<bool> strings;
+};
+
+/// @brief 整个apk共享的指令预算
+class InstructionBudget {
+private:
+    std::atomic<int64_t> remaining_;
+    bool limited_;
+    std::atomic<bool> exhausted_{false};
+
+public:
+    explicit InstructionBudget(uint64_t budget)
+          : remaining_(static_cast<int64_t>(std::min<uint64_t>(budget, INT64_MAX))),
+            limited_(budget != 0){};
+
+    /// @brief 消耗count条指令的预算
+    /// @return 预算耗尽返回false
+    bool Consume(uint32_t count) {
+        if (!limited_) {
+            return true;
+        }
+        if (remaining_.fetch_sub(count) - static_cast<int64_t>(count) < 0) {
+            exhausted_ = true;
+        }
+        return !exhausted_;
+    }
+
+    bool Exhausted() const { return exhausted_; }
+};
+
+/// @brief 解码一个类的所有方法, 记录引用的方法、字段和字符串下标
+/// @return 预算耗尽返回false
+static bool ScanClass(const art::DexFile& dexFile, const art::dex::ClassDef& classDef,
+                      InstructionBudget* budget, DexReferences* refs) {
+    art::ClassAccessor accessor(dexFile, classDef);
+    for (const art::ClassAccessor::Method& method : accessor.GetMethods()) {
+        uint32_t decoded = 0;
+        // verifier只检查code item的结构, 不检查指令边界, 每条指令解码前确认完整地落在
+        // insns之内; 最后一条指令被截断或payload的长度字段越界时停止解码这个方法
+        art::CodeItemInstructionAccessor instructions = method.GetInstructions();
+        const uint32_t insnsSize = instructions.InsnsSizeInCodeUnits();
+        for (uint32_t dexPc = 0; dexPc < insnsSize;) {
+            const art::Instruction& inst = instructions.InstructionAt(dexPc);
+            const size_t available = insnsSize - dexPc;
+            if (inst.CodeUnitsRequiredForSizeComputation() > available ||
+                inst.SizeInCodeUnits() > available) {
+                break;
+            }
+            dexPc += inst.SizeInCodeUnits();
+            if (++decoded == kBudgetChunk) {
+                if (!budget->Consume(decoded)) {
+                    return false;
+                }
+                decoded = 0;
+            }
+            uint32_t index;
+            std::vector<bool>* target;
+            switch (inst.Opcode()) {
+                case art::Instruction::INVOKE_VIRTUAL:
+                case art::Instruction::INVOKE_SUPER:
+                case art::Instruction::INVOKE_DIRECT:
+                case art::Instruction::INVOKE_STATIC:
+                case art::Instruction::INVOKE_INTERFACE:
+                    index = inst.VRegB_35c();
+                    target = &refs->methods;
+                    break;
+                case art::Instruction::INVOKE_VIRTUAL_RANGE:
+                case art::Instruction::INVOKE_SUPER_RANGE:
+                case art::Instruction::INVOKE_DIRECT_RANGE:
+                case art::Instruction::INVOKE_STATIC_RANGE:
+                case art::Instruction::INVOKE_INTERFACE_RANGE:
+                    index = inst.VRegB_3rc();
+                    target = &refs->methods;
+                    break;
+                case art::Instruction::INVOKE_POLYMORPHIC:
+                    index = inst.VRegB_45cc();
+                    target = &refs->methods;
+                    break;
+                case art::Instruction::INVOKE_POLYMORPHIC_RANGE:
+                    index = inst.VRegB_4rcc();
+                    target = &refs->methods;
+                    break;
+                case art::Instruction::CONST_STRING:
+                    index = inst.VRegB_21c();
+                    target = &refs->strings;
+                    break;
+                case art::Instruction::CONST_STRING_JUMBO:
+                    index = inst.VRegB_31c();
+                    target = &refs->strings;
+                    break;
+                case art::Instruction::IGET:
+                case art::Instruction::IGET_WIDE:
+                case art::Instruction::IGET_OBJECT:
+                case art::Instruction::IGET_BOOLEAN:
+                case art::Instruction::IGET_BYTE:
+                case art::Instruction::IGET_CHAR:
+                case art::Instruction::IGET_SHORT:
+                case art::Instruction::IPUT:
+                case art::Instruction::IPUT_WIDE:
+                case art::Instruction::IPUT_OBJECT:
+                case art::Instruction::IPUT_BOOLEAN:
+                case art::Instruction::IPUT_BYTE:
+                case art::Instruction::IPUT_CHAR:
+                case art::Instruction::IPUT_SHORT:
+                    index = inst.VRegC_22c();
+                    target = &refs->fields;
+                    break;
+                case art::Instruction::SGET:
+                case art::Instruction::SGET_WIDE:
+                case art::Instruction::SGET_OBJECT:
+                case art::Instruction::SGET_BOOLEAN:
+                case art::Instruction::SGET_BYTE:
+                case art::Instruction::SGET_CHAR:
+                case art::Instruction::SGET_SHORT:
+                case art::Instruction::SPUT:
+                case art::Instruction::SPUT_WIDE:
+                case art::Instruction::SPUT_OBJECT:
+                case art::Instruction::SPUT_BOOLEAN:
+                case art::Instruction::SPUT_BYTE:
+                case art::Instruction::SPUT_CHAR:
+                case art::Instruction::SPUT_SHORT:
+                    index = inst.VRegB_21c();
+                    target = &refs->fields;
+                    break;
+                default:
+                    continue;
+            }
+            if (index < target->size()) {
+                (*target)[index] = true;
+            }
+        }
+        if (!budget->Consume(decoded)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief 把引用到的下标渲染成签名加入result
+static void RenderReferences(const art::DexFile& dexFile, const DexReferences& refs,
+                             InvokeResult* result) {
+    std::string buffer;
+    for (uint32_t i = 0; i < refs.methods.size(); i++) {
+        if (!refs.methods[i]) {
+            continue;
+        }
+        const art::dex::MethodId& methodId = dexFile.GetMethodId(i);
+        std::string signature = dexFile.GetMethodDeclaringClassDescriptor(methodId);
+        signature.append("->").append(dexFile.GetMethodName(methodId));
+        signature.append(dexFile.GetMethodSignature(methodId).ToString());
+        result->methods.Intern(Apk::DecodeDexString(signature, &buffer));
+    }
+    for (uint32_t i = 0; i < refs.fields.size(); i++) {
+        if (!refs.fields[i]) {
+            continue;
+        }
+        const art::dex::FieldId& fieldId = dexFile.GetFieldId(i);
+        std::string signature = dexFile.GetFieldDeclaringClassDescriptor(fieldId);
+        signature.append("->").append(dexFile.GetFieldName(fieldId)).append(":");
+        signature.append(dexFile.GetFieldTypeDescriptor(fieldId));
+        result->fields.Intern(Apk::DecodeDexString(signature, &buffer));
+    }
+    for (uint32_t i = 0; i < refs.strings.size(); i++) {
+        if (!refs.strings[i]) {
+            continue;
+        }
+        std::string_view str = Apk::DecodeDexString(
+                dexFile.GetStringData(dexFile.GetStringId(art::dex::StringIndex(i))), &buffer);
+        if (!str.empty()) {
+            result->strings.Intern(str);
+        }
+    }
+}
+
+std::unique_ptr<InvokeResult> Apk::ParseInvokes(const DexOptions& options) const {
+    std::unique_ptr<InvokeResult> result(new InvokeResult());
+    InstructionBudget budget(options.instructionBudget);
+    for (aapt::io::IFile* file : FindDexFiles()) {
+        if (budget.Exhausted()) {
+            break;
+        }
+        std::unique_ptr<aapt::io::IData> data = file->OpenAsData();
+        if (data == nullptr) {
+            continue;
+        }
+        // 遍历代码需要校验过的dex, 避免越界读取
+        std::unique_ptr<const art::DexFile> dexFile =
+                Apk::OpenDexFile(reinterpret_cast<const uint8_t*>(data->data()), data->size(),
+                                 file->GetSource().path, /*verify=*/true);
+        if (dexFile == nullptr) {
+            std::cerr << "failed to load " << file->GetSource().path << std::endl;
+            continue;
+        }
+        // 按类分配到工作线程, 每个线程用自己的位图记录引用, 最后合并
+        size_t workers = ResolveWorkerCount(options.threads, dexFile->NumClassDefs());
+        std::vector<DexReferences> partials(workers);
+        for (auto& refs : partials) {
+            refs.methods.resize(dexFile->NumMethodIds());
+            refs.fields.resize(dexFile->NumFieldIds());
+            refs.strings.resize(dexFile->NumStringIds());
+        }
+        ParallelFor(dexFile->NumClassDefs(), workers, [&](size_t index, size_t worker) {
+            if (!budget.Exhausted()) {
+                ScanClass(*dexFile, dexFile->GetClassDef(index), &budget, &partials[worker]);
+            }
+        });
+        for (size_t w = 1; w < partials.size(); w++) {
+            for (auto member : {&DexReferences::methods, &DexReferences::fields,
+                                &DexReferences::strings}) {
+                std::vector<bool>& merged = partials[0].*member;
+                const std::vector<bool>& partial = partials[w].*member;
+                for (size_t i = 0; i < partial.size(); i++) {
+                    if (partial[i]) {
+                        merged[i] = true;
+                    }
+                }
+            }
+        }
+        RenderReferences(*dexFile, partials[0], result.get());
+    }
+    result->truncated = budget.Exhausted();
+    return result;
+}
+
+} // namespace apkparser
@@ -0,0 +1,132 @@
+#include "DexMembers.h"
+
+#include <cstring>
+
+#include "DexReader.h"
+#include "StringKernels.h"
+
+namespace apkparser {
+
+/// @brief MUTF-8转换为UTF-8, ASCII直接返回原视图, 否则存放在arena中
+static std::string_view DecodeName(std::string_view mutf8, StringArena* arena) {
+    if (IsAscii(mutf8.data(), mutf8.size())) {
+        return mutf8;
+    }
+    std::string utf8;
+    MutfToUtf8(mutf8, &utf8);
+    return arena->Copy(utf8);
+}
+
+/// @brief 把多个片段连续写入arena
+static std::string_view Concat(std::initializer_list<std::string_view> parts, StringArena* arena) {
+    size_t size = 0;
+    for (std::string_view part : parts) {
+        size += part.size();
+    }
+    char* dest = arena->Reserve(size);
+    char* cursor = dest;
+    for (std::string_view part : parts) {
+        memcpy(cursor, part.data(), part.size());
+        cursor += part.size();
+    }
+    arena->Commit(size);
+    return std::string_view(dest, size);
+}
+
+bool ExtractDexMembers(std::unique_ptr<aapt::io::IData> data, DexMembers* out,
+                       std::string* error) {
+    std::unique_ptr<DexReader> reader =
+            DexReader::Open(reinterpret_cast<const uint8_t*>(data->data()), data->size(), error);
+    if (reader == nullptr) {
+        return false;
+    }
+    StringArena* arena = &out->arena;
+
+    // 类型名只解码一次, 字段和方法按下标引用
+    std::vector<std::string_view> types(reader->NumTypeIds());
+    std::vector<bool> typeValid(reader->NumTypeIds(), false);
+    out->types.reserve(reader->NumTypeIds());
+    for (uint32_t i = 0; i < reader->NumTypeIds(); i++) {
+        std::string_view descriptor;
+        if (reader->GetTypeDescriptor(i, &descriptor)) {
+            types[i] = DecodeName(descriptor, arena);
+            typeValid[i] = true;
+            out->types.push_back(types[i]);
+        }
+    }
+    auto typeAt = [&](uint32_t typeIdx, std::string_view* type) {
+        if (typeIdx >= types.size() || !typeValid[typeIdx]) {
+            return false;
+        }
+        *type = types[typeIdx];
+        return true;
+    };
+    auto nameAt = [&](uint32_t stringIdx, std::string_view* name) {
+        if (!reader->GetString(stringIdx, name)) {
+            return false;
+        }
+        *name = DecodeName(*name, arena);
+        return true;
+    };
+
+    out->fields.reserve(reader->NumFieldIds());
+    for (uint32_t i = 0; i < reader->NumFieldIds(); i++) {
+        uint16_t classIdx, typeIdx;
+        uint32_t nameIdx;
+        std::string_view owner, type, name;
+        if (reader->GetFieldId(i, &classIdx, &typeIdx, &nameIdx) && typeAt(classIdx, &owner) &&
+            typeAt(typeIdx, &type) && nameAt(nameIdx, &name)) {
+            out->fields.push_back(Concat({owner, "->", name, ":", type}, arena));
+        }
+    }
+
+    // 方法原型在第一次使用时渲染, 多个方法共享同一个原型
+    std::vector<std::string_view> protos(reader->NumProtoIds());
+    std::vector<uint8_t> protoState(reader->NumProtoIds(), 0); // 0:未渲染 1:有效 2:无效
+    std::vector<uint16_t> parameters;
+    std::string buffer;
+    auto protoAt = [&](uint32_t protoIdx, std::string_view* proto) {
+        if (protoIdx >= protos.size()) {
+            return false;
+        }
+        if (protoState[protoIdx] == 0) {
+            protoState[protoIdx] = 2;
+            uint32_t returnTypeIdx;
+            std::string_view type;
+            if (!reader->GetProto(protoIdx, &returnTypeIdx, &parameters)) {
+                return false;
+            }
+            buffer.assign("(");
+            for (uint16_t parameter : parameters) {
+                if (!typeAt(parameter, &type)) {
+                    return false;
+                }
+                buffer.append(type);
+            }
+            buffer.push_back(')');
+            if (!typeAt(returnTypeIdx, &type)) {
+                return false;
+            }
+            buffer.append(type);
+            protos[protoIdx] = arena->Copy(buffer);
+            protoState[protoIdx] = 1;
+        }
+        *proto = protos[protoIdx];
+        return protoState[protoIdx] == 1;
+    };
+
+    out->methods.reserve(reader->NumMethodIds());
+    for (uint32_t i = 0; i < reader->NumMethodIds(); i++) {
+        uint16_t classIdx, protoIdx;
+        uint32_t nameIdx;
+        std::string_view owner, proto, name;
+        if (reader->GetMethodId(i, &classIdx, &protoIdx, &nameIdx) && typeAt(classIdx, &owner) &&
+            protoAt(protoIdx, &proto) && nameAt(nameIdx, &name)) {
+            out->methods.push_back(Concat({owner, "->", name, proto}, arena));
+        }
+    }
+    out->data = std::move(data);
+    return true;
+}
+
+} // namespace apkparser
@@ -0,0 +1,42 @@
+#ifndef APKPARSER_DEX_MEMBERS_H
+#define APKPARSER_DEX_MEMBERS_H
+
+#include <io/Data.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "StringTable.h"
+
+namespace apkparser {
+
+/// @brief 一个dex中type_ids、field_ids、method_ids渲染成的签名, 顺序和dex中的表一致
+struct DexMembers {
+    /// dex在apk中的路径
+    std::string location;
+    /// 类型描述符, 如 Lcom/x/Y;
+    std::vector<std::string_view> types;
+    /// 字段签名, 如 Lcom/x/Y;->bar:I
+    std::vector<std::string_view> fields;
+    /// 方法签名, 如 Lcom/x/Y;->foo(I)V
+    std::vector<std::string_view> methods;
+    /// 渲染后的签名和非ASCII名称的UTF-8副本
+    StringArena arena;
+    /// ASCII的类型描述符直接引用dex数据
+    std::unique_ptr<aapt::io::IData> data;
+};
+
+/// @brief 用DexReader读取dex的type_ids、proto_ids、field_ids、method_ids并渲染成签名
+///
+/// 类型名和方法原型各只解码/渲染一次, 之后按下标复用, 渲染总开销和表大小成线性
+/// @param data 解压后的dex, 成功时转移到out->data
+/// @param out 输出, location需要调用者设置
+/// @return dex表不完整返回false
+bool ExtractDexMembers(std::unique_ptr<aapt::io::IData> data, DexMembers* out,
+                       std::string* error);
+
+} // namespace apkparser
+
+#endif // APKPARSER_DEX_MEMBERS_H
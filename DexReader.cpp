@@ -0,0 +1,159 @@
+#include "DexReader.h"
+
+#include <android-base/stringprintf.h>
+
+#include <cstring>
+
+using ::android::base::StringPrintf;
+
+namespace apkparser {
+
+constexpr static uint32_t kDexEndianConstant = 0x12345678;
+constexpr static size_t kStringIdItemSize = 4;
+constexpr static size_t kTypeIdItemSize = 4;
+constexpr static size_t kClassDefItemSize = 32;
+constexpr static size_t kProtoIdItemSize = 12;
+constexpr static size_t kFieldIdItemSize = 8;
+constexpr static size_t kMethodIdItemSize = 8;
+
+bool DexReader::IsDexMagic(const uint8_t* base, size_t size) {
+    // dex\n035\0, 版本号三位数字
+    return size >= 8 && memcmp(base, "dex\n", 4) == 0 && base[7] == '\0';
+}
+
+std::unique_ptr<DexReader> DexReader::Open(const uint8_t* base, size_t size,
+                                           std::string* error) {
+    if (size < sizeof(DexHeader) || !IsDexMagic(base, size)) {
+        *error = "not a dex file";
+        return {};
+    }
+    DexHeader header;
+    memcpy(&header, base, sizeof(DexHeader));
+    if (header.endianTag != kDexEndianConstant) {
+        *error = StringPrintf("unsupported endian tag 0x%08x", header.endianTag);
+        return {};
+    }
+    if (header.headerSize < sizeof(DexHeader) || header.headerSize > size) {
+        *error = StringPrintf("invalid header size %u", header.headerSize);
+        return {};
+    }
+    // 各个表必须完整地落在数据内
+    auto tableInBounds = [size](uint32_t count, uint32_t offset, size_t itemSize) {
+        return count == 0 || static_cast<uint64_t>(offset) + count * itemSize <= size;
+    };
+    if (!tableInBounds(header.stringIdsSize, header.stringIdsOff, kStringIdItemSize)) {
+        *error = "string_ids out of bounds";
+        return {};
+    }
+    if (!tableInBounds(header.typeIdsSize, header.typeIdsOff, kTypeIdItemSize)) {
+        *error = "type_ids out of bounds";
+        return {};
+    }
+    if (!tableInBounds(header.classDefsSize, header.classDefsOff, kClassDefItemSize)) {
+        *error = "class_defs out of bounds";
+        return {};
+    }
+    return std::unique_ptr<DexReader>(new DexReader(base, size, header));
+}
+
+bool DexReader::ReadU32(uint64_t offset, uint32_t* out) const {
+    if (offset + sizeof(uint32_t) > size_) {
+        return false;
+    }
+    memcpy(out, base_ + offset, sizeof(uint32_t));
+    return true;
+}
+
+bool DexReader::ReadU16(uint64_t offset, uint16_t* out) const {
+    if (offset + sizeof(uint16_t) > size_) {
+        return false;
+    }
+    memcpy(out, base_ + offset, sizeof(uint16_t));
+    return true;
+}
+
+bool DexReader::GetString(uint32_t stringIdx, std::string_view* out) const {
+    uint32_t dataOff;
+    if (stringIdx >= header_.stringIdsSize ||
+        !ReadU32(header_.stringIdsOff + static_cast<uint64_t>(stringIdx) * kStringIdItemSize,
+                 &dataOff)) {
+        return false;
+    }
+    // 跳过uleb128编码的utf16长度, 最多5个字节
+    size_t pos = dataOff;
+    for (size_t i = 0; i < 5; i++) {
+        if (pos >= size_) {
+            return false;
+        }
+        if ((base_[pos++] & 0x80) == 0) {
+            break;
+        }
+    }
+    const void* end = memchr(base_ + pos, '\0', size_ - pos);
+    if (end == nullptr) {
+        return false;
+    }
+    *out = std::string_view(reinterpret_cast<const char*>(base_ + pos),
+                            static_cast<const uint8_t*>(end) - (base_ + pos));
+    return true;
+}
+
+bool DexReader::GetTypeDescriptor(uint32_t typeIdx, std::string_view* out) const {
+    uint32_t descriptorIdx;
+    if (typeIdx >= header_.typeIdsSize ||
+        !ReadU32(header_.typeIdsOff + static_cast<uint64_t>(typeIdx) * kTypeIdItemSize,
+                 &descriptorIdx)) {
+        return false;
+    }
+    return GetString(descriptorIdx, out);
+}
+
+bool DexReader::GetClassDescriptor(uint32_t classDefIdx, std::string_view* out) const {
+    // class_def_item的第一个字段是class_idx
+    uint32_t classIdx;
+    if (classDefIdx >= header_.classDefsSize ||
+        !ReadU32(header_.classDefsOff + static_cast<uint64_t>(classDefIdx) * kClassDefItemSize,
+                 &classIdx)) {
+        return false;
+    }
+    return GetTypeDescriptor(classIdx, out);
+}
+
+bool DexReader::GetProto(uint32_t protoIdx, uint32_t* returnTypeIdx,
+                         std::vector<uint16_t>* parameters) const {
+    parameters->clear();
+    uint64_t item = header_.protoIdsOff + static_cast<uint64_t>(protoIdx) * kProtoIdItemSize;
+    uint32_t parametersOff;
+    if (protoIdx >= header_.protoIdsSize || !ReadU32(item + 4, returnTypeIdx) ||
+        !ReadU32(item + 8, &parametersOff)) {
+        return false;
+    }
+    // parameters_off为0表示没有参数, 否则指向type_list
+    if (parametersOff == 0) {
+        return true;
+    }
+    uint32_t count;
+    if (!ReadU32(parametersOff, &count) ||
+        parametersOff + 4 + static_cast<uint64_t>(count) * sizeof(uint16_t) > size_) {
+        return false;
+    }
+    parameters->resize(count);
+    memcpy(parameters->data(), base_ + parametersOff + 4, count * sizeof(uint16_t));
+    return true;
+}
+
+bool DexReader::GetFieldId(uint32_t fieldIdx, uint16_t* classIdx, uint16_t* typeIdx,
+                           uint32_t* nameIdx) const {
+    uint64_t item = header_.fieldIdsOff + static_cast<uint64_t>(fieldIdx) * kFieldIdItemSize;
+    return fieldIdx < header_.fieldIdsSize && ReadU16(item, classIdx) &&
+           ReadU16(item + 2, typeIdx) && ReadU32(item + 4, nameIdx);
+}
+
+bool DexReader::GetMethodId(uint32_t methodIdx, uint16_t* classIdx, uint16_t* protoIdx,
+                            uint32_t* nameIdx) const {
+    uint64_t item = header_.methodIdsOff + static_cast<uint64_t>(methodIdx) * kMethodIdItemSize;
+    return methodIdx < header_.methodIdsSize && ReadU16(item, classIdx) &&
+           ReadU16(item + 2, protoIdx) && ReadU32(item + 4, nameIdx);
+}
+
+} // namespace apkparser
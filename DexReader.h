@@ -0,0 +1,111 @@
+#ifndef APKPARSER_DEX_READER_H
+#define APKPARSER_DEX_READER_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace apkparser {
+
+/// @brief dex文件头, 布局和dex格式一致
+struct DexHeader {
+    uint8_t magic[8];
+    uint32_t checksum;
+    uint8_t signature[20];
+    uint32_t fileSize;
+    uint32_t headerSize;
+    uint32_t endianTag;
+    uint32_t linkSize;
+    uint32_t linkOff;
+    uint32_t mapOff;
+    uint32_t stringIdsSize;
+    uint32_t stringIdsOff;
+    uint32_t typeIdsSize;
+    uint32_t typeIdsOff;
+    uint32_t protoIdsSize;
+    uint32_t protoIdsOff;
+    uint32_t fieldIdsSize;
+    uint32_t fieldIdsOff;
+    uint32_t methodIdsSize;
+    uint32_t methodIdsOff;
+    uint32_t classDefsSize;
+    uint32_t classDefsOff;
+    uint32_t dataSize;
+    uint32_t dataOff;
+};
+
+static_assert(sizeof(DexHeader) == 0x70, "dex header size mismatch");
+
+/// @brief 轻量的dex表读取器, 读取header、string_ids、type_ids、class_defs和字符串数据,
+/// 以及用于签名的proto_ids、field_ids、method_ids
+///
+/// 直接在解压后的数据上读取, 不拷贝, 不要求对齐, 所有访问都做边界检查.
+/// 不校验checksum, Open只检查提取类和字符串需要的表, proto_ids等表在访问时检查,
+/// 所以libdexfile拒绝但字符串表完好的dex也能读取
+class DexReader {
+private:
+    const uint8_t* base_;
+    size_t size_;
+    DexHeader header_;
+
+    DexReader(const uint8_t* base, size_t size, const DexHeader& header)
+          : base_(base), size_(size), header_(header){};
+
+    /// @brief 读取offset处的uint32, 越界返回false
+    bool ReadU32(uint64_t offset, uint32_t* out) const;
+
+    /// @brief 读取offset处的uint16, 越界返回false
+    bool ReadU16(uint64_t offset, uint16_t* out) const;
+
+public:
+    /// @brief 检查header和各个表的边界
+    /// @param base dex数据, 读取器存活期间必须有效
+    /// @param error 失败原因
+    /// @return 不是dex或表越界返回nullptr
+    static std::unique_ptr<DexReader> Open(const uint8_t* base, size_t size, std::string* error);
+
+    /// @brief 快速判断数据是否以dex magic开头
+    static bool IsDexMagic(const uint8_t* base, size_t size);
+
+    const DexHeader& GetHeader() const { return header_; }
+
+    uint32_t NumStringIds() const { return header_.stringIdsSize; }
+
+    uint32_t NumTypeIds() const { return header_.typeIdsSize; }
+
+    uint32_t NumClassDefs() const { return header_.classDefsSize; }
+
+    uint32_t NumProtoIds() const { return header_.protoIdsSize; }
+
+    uint32_t NumFieldIds() const { return header_.fieldIdsSize; }
+
+    uint32_t NumMethodIds() const { return header_.methodIdsSize; }
+
+    /// @brief 读取字符串数据, 结果是MUTF-8编码, 不含结尾的\0
+    /// @return 下标或数据越界返回false
+    bool GetString(uint32_t stringIdx, std::string_view* out) const;
+
+    /// @brief 读取类型描述符, 如 Lcom/a/B;
+    bool GetTypeDescriptor(uint32_t typeIdx, std::string_view* out) const;
+
+    /// @brief 读取第classDefIdx个类定义的描述符
+    bool GetClassDescriptor(uint32_t classDefIdx, std::string_view* out) const;
+
+    /// @brief 读取proto_id_item的返回类型和参数类型列表
+    /// @param parameters 参数的type_idx, 先清空
+    bool GetProto(uint32_t protoIdx, uint32_t* returnTypeIdx,
+                  std::vector<uint16_t>* parameters) const;
+
+    /// @brief 读取field_id_item
+    bool GetFieldId(uint32_t fieldIdx, uint16_t* classIdx, uint16_t* typeIdx,
+                    uint32_t* nameIdx) const;
+
+    /// @brief 读取method_id_item
+    bool GetMethodId(uint32_t methodIdx, uint16_t* classIdx, uint16_t* protoIdx,
+                     uint32_t* nameIdx) const;
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_DEX_READER_H
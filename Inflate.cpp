@@ -0,0 +1,572 @@
+#include "Inflate.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+
+namespace apkparser {
+
+static std::atomic<InflateBackend> gInflateBackend{InflateBackend::kOneShot};
+
+InflateBackend GetInflateBackend() {
+    return gInflateBackend.load(std::memory_order_relaxed);
+}
+
+void SetInflateBackend(InflateBackend backend) {
+    gInflateBackend.store(backend, std::memory_order_relaxed);
+}
+
+const char* InflateBackendName(InflateBackend backend) {
+    switch (backend) {
+        case InflateBackend::kZlib:
+            return "zlib";
+        case InflateBackend::kOneShot:
+            return "oneshot";
+    }
+    return "unknown";
+}
+
+bool Inflate(const uint8_t* in, size_t inSize, uint8_t* out, size_t size) {
+    if (GetInflateBackend() == InflateBackend::kOneShot && InflateOneShot(in, inSize, out, size)) {
+        return true;
+    }
+    return InflateZlib(in, inSize, out, size, /*complete=*/true);
+}
+
+bool InflateZlib(const uint8_t* in, uint64_t inSize, uint8_t* out, uint64_t size, bool complete) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<uint8_t*>(in);
+    stream.next_out = out;
+    uint64_t inLeft = inSize;
+    uint64_t outLeft = size;
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        // avail_in/avail_out是32位的, 大条目分段喂入
+        if (stream.avail_in == 0 && inLeft > 0) {
+            stream.avail_in = static_cast<uInt>(std::min<uint64_t>(inLeft, UINT_MAX));
+            inLeft -= stream.avail_in;
+        }
+        if (stream.avail_out == 0) {
+            if (outLeft == 0 && !complete) {
+                break;
+            }
+            // 输出已满时继续调用, 让zlib处理数据流的结束标记
+            stream.avail_out = static_cast<uInt>(std::min<uint64_t>(outLeft, UINT_MAX));
+            outLeft -= stream.avail_out;
+        }
+        ret = inflate(&stream, Z_NO_FLUSH);
+    }
+    bool full = outLeft == 0 && stream.avail_out == 0;
+    inflateEnd(&stream);
+    return full && (complete ? ret == Z_STREAM_END : ret == Z_OK || ret == Z_STREAM_END);
+}
+
+// 以下是整块解码器. 霍夫曼表的构造方式和zlib的inflate_table相同:
+// 一级表按码字的低rootBits位索引, 更长的码字通过二级表解码.
+// 和libdeflate一样, 表项中直接存放字面量、长度和距离的基数以及额外位数, 解码一个符号只查一次表
+
+constexpr static unsigned kMaxCodeBits = 15;
+constexpr static unsigned kNumLitLenSymbols = 288;
+constexpr static unsigned kNumDistSymbols = 32;
+constexpr static unsigned kNumCodeLenSymbols = 19;
+// 动态块中有效的符号数, 286、287和30、31只出现在固定编码中
+constexpr static unsigned kMaxDynamicLitLen = 286;
+constexpr static unsigned kMaxDynamicDist = 30;
+constexpr static unsigned kLitLenRootBits = 11;
+constexpr static unsigned kDistRootBits = 8;
+constexpr static unsigned kCodeLenRootBits = 7;
+// 一级表加上所有二级表的最大尺寸, 和libdeflate对相同位数的计算结果一致
+constexpr static size_t kLitLenTableSize = 2342;
+constexpr static size_t kDistTableSize = 402;
+constexpr static size_t kCodeLenTableSize = 1 << kCodeLenRootBits;
+
+// 表项的op
+constexpr static uint8_t kOpLiteral = 0x00;
+// 0x01-0x0f: 指向二级表, 值为二级表的位数
+constexpr static uint8_t kOpMaxLink = 0x0f;
+// 0x10 | 额外位数: 长度或距离, val为基数
+constexpr static uint8_t kOpBase = 0x10;
+constexpr static uint8_t kOpEndOfBlock = 0x20;
+constexpr static uint8_t kOpInvalid = 0x40;
+
+constexpr static unsigned kEndOfBlock = 256;
+// 输入结束后最多补充的0字节数, 超过说明数据被截断
+constexpr static size_t kMaxOverrun = 8;
+
+constexpr static uint16_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,   9,   10,  11,  13,
+                                             15, 17, 19, 23, 27, 31,  35,  43,  51,  59,
+                                             67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr static uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                             2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr static uint16_t kDistBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,
+                                           17,   25,   33,   49,   65,   97,    129,   193,
+                                           257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                           4097, 6145, 8193, 12289, 16385, 24577};
+constexpr static uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                           6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+constexpr static uint8_t kCodeLenOrder[kNumCodeLenSymbols] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                                              11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+struct HuffmanCode {
+    uint8_t op;
+    uint8_t bits;
+    uint16_t val;
+};
+
+/// @brief 霍夫曼解码表, 一级表之后是二级表
+template <size_t N>
+struct HuffmanTable {
+    HuffmanCode codes[N];
+    unsigned rootBits;
+};
+
+/// @brief 符号在各个表中的含义
+enum class Alphabet {
+    kCodeLen,
+    kLitLen,
+    kDist,
+};
+
+static HuffmanCode MakeCode(Alphabet alphabet, unsigned symbol, unsigned bits) {
+    uint8_t len = static_cast<uint8_t>(bits);
+    switch (alphabet) {
+        case Alphabet::kCodeLen:
+            return {kOpLiteral, len, static_cast<uint16_t>(symbol)};
+        case Alphabet::kLitLen:
+            if (symbol < kEndOfBlock) {
+                return {kOpLiteral, len, static_cast<uint16_t>(symbol)};
+            }
+            if (symbol == kEndOfBlock) {
+                return {kOpEndOfBlock, len, 0};
+            }
+            if (symbol - (kEndOfBlock + 1) < 29) {
+                symbol -= kEndOfBlock + 1;
+                return {static_cast<uint8_t>(kOpBase | kLengthExtra[symbol]), len,
+                        kLengthBase[symbol]};
+            }
+            return {kOpInvalid, len, 0};
+        case Alphabet::kDist:
+            if (symbol < 30) {
+                return {static_cast<uint8_t>(kOpBase | kDistExtra[symbol]), len,
+                        kDistBase[symbol]};
+            }
+            return {kOpInvalid, len, 0};
+    }
+    return {kOpInvalid, len, 0};
+}
+
+/// @brief 根据码长构造解码表, 算法和zlib的inflate_table相同
+/// @param allowIncomplete 是否允许只有一个码字的不完整编码, 码长表不允许
+/// @return 码长非法或超出表的尺寸返回false
+template <size_t N>
+static bool BuildHuffmanTable(const uint8_t* lens, unsigned count, Alphabet alphabet,
+                              unsigned rootBits, bool allowIncomplete, HuffmanTable<N>* table) {
+    uint16_t counts[kMaxCodeBits + 1] = {0};
+    uint16_t offsets[kMaxCodeBits + 1];
+    uint16_t sorted[kNumLitLenSymbols];
+    for (unsigned sym = 0; sym < count; sym++) {
+        counts[lens[sym]]++;
+    }
+    unsigned max = kMaxCodeBits;
+    while (max >= 1 && counts[max] == 0) {
+        max--;
+    }
+    if (max == 0) {
+        // 没有任何码字, 解码时一定失败
+        table->codes[0] = {kOpInvalid, 1, 0};
+        table->codes[1] = {kOpInvalid, 1, 0};
+        table->rootBits = 1;
+        return true;
+    }
+    unsigned min = 1;
+    while (min < max && counts[min] == 0) {
+        min++;
+    }
+    unsigned root = std::max(std::min(rootBits, max), min);
+    int left = 1;
+    for (unsigned len = 1; len <= kMaxCodeBits; len++) {
+        left <<= 1;
+        left -= counts[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+    if (left > 0 && (!allowIncomplete || max != 1)) {
+        return false;
+    }
+    offsets[1] = 0;
+    for (unsigned len = 1; len < kMaxCodeBits; len++) {
+        offsets[len + 1] = offsets[len] + counts[len];
+    }
+    for (unsigned sym = 0; sym < count; sym++) {
+        if (lens[sym] != 0) {
+            sorted[offsets[lens[sym]]++] = static_cast<uint16_t>(sym);
+        }
+    }
+
+    // huff是按位反转后递增的码字, 因为deflate从低位开始读取码字
+    unsigned huff = 0;
+    unsigned sym = 0;
+    unsigned len = min;
+    HuffmanCode* next = table->codes;
+    unsigned curr = root;
+    unsigned drop = 0;
+    unsigned low = UINT_MAX;
+    unsigned used = 1U << root;
+    unsigned mask = used - 1;
+    if (used > N) {
+        return false;
+    }
+    while (true) {
+        HuffmanCode here = MakeCode(alphabet, sorted[sym], len - drop);
+        unsigned incr = 1U << (len - drop);
+        unsigned fill = 1U << curr;
+        unsigned size = fill;
+        do {
+            fill -= incr;
+            next[(huff >> drop) + fill] = here;
+        } while (fill != 0);
+        incr = 1U << (len - 1);
+        while (huff & incr) {
+            incr >>= 1;
+        }
+        huff = incr != 0 ? (huff & (incr - 1)) + incr : 0;
+        sym++;
+        if (--counts[len] == 0) {
+            if (len == max) {
+                break;
+            }
+            len = lens[sorted[sym]];
+        }
+        // 码字超过一级表的位数, 为新的前缀创建二级表
+        if (len > root && (huff & mask) != low) {
+            if (drop == 0) {
+                drop = root;
+            }
+            next += size;
+            curr = len - drop;
+            left = 1 << curr;
+            while (curr + drop < max) {
+                left -= counts[curr + drop];
+                if (left <= 0) {
+                    break;
+                }
+                curr++;
+                left <<= 1;
+            }
+            used += 1U << curr;
+            if (used > N) {
+                return false;
+            }
+            low = huff & mask;
+            table->codes[low] = {static_cast<uint8_t>(curr), static_cast<uint8_t>(root),
+                                 static_cast<uint16_t>(next - table->codes)};
+        }
+    }
+    if (huff != 0) {
+        // 只有一个码字的不完整编码, 剩下的位置是非法码字
+        next[huff] = {kOpInvalid, static_cast<uint8_t>(len - drop), 0};
+    }
+    table->rootBits = root;
+    return true;
+}
+
+/// @brief 64位的位缓冲区, 每次补充后至少有56位可用
+class BitReader {
+private:
+    const uint8_t* in_;
+    const uint8_t* end_;
+    uint64_t buffer_ = 0;
+    unsigned count_ = 0;
+    // 输入结束后补充的0字节数
+    size_t overrun_ = 0;
+
+public:
+    BitReader(const uint8_t* in, size_t size) : in_(in), end_(in + size){};
+
+    void Refill() {
+        if (end_ - in_ >= 8) {
+            // 一次读入8个字节, 只计入能放下的整字节; 超出count_的高位和下次读入的内容相同
+            uint64_t word;
+            memcpy(&word, in_, sizeof(word));
+            buffer_ |= word << count_;
+            in_ += (63 - count_) >> 3;
+            count_ |= 56;
+            return;
+        }
+        while (count_ < 56) {
+            uint64_t byte = 0;
+            if (in_ < end_) {
+                byte = *in_++;
+            } else {
+                overrun_++;
+            }
+            buffer_ |= byte << count_;
+            count_ += 8;
+        }
+    }
+
+    uint32_t Peek(unsigned n) const { return static_cast<uint32_t>(buffer_ & ((1ULL << n) - 1)); }
+
+    void Drop(unsigned n) {
+        buffer_ >>= n;
+        count_ -= n;
+    }
+
+    uint32_t Read(unsigned n) {
+        uint32_t value = Peek(n);
+        Drop(n);
+        return value;
+    }
+
+    bool Overrun() const { return overrun_ > kMaxOverrun; }
+
+    /// @brief 是否没有读取输入之外的数据
+    bool Consistent() const { return overrun_ <= count_ / 8; }
+
+    /// @brief 丢弃不足一个字节的位, 之后按字节读取stored块
+    void AlignToByte() { Drop(count_ & 7); }
+
+    /// @brief 把缓冲区中的整字节退回输入
+    /// @return 缓冲区中包含补充的0字节时返回false
+    bool Rewind() {
+        size_t buffered = count_ >> 3;
+        if (buffered < overrun_) {
+            return false;
+        }
+        in_ -= buffered - overrun_;
+        overrun_ = 0;
+        buffer_ = 0;
+        count_ = 0;
+        return true;
+    }
+
+    const uint8_t* Position() const { return in_; }
+
+    size_t Remaining() const { return end_ - in_; }
+
+    void Skip(size_t n) { in_ += n; }
+};
+
+/// @brief 查表解码一个符号并消耗对应的位, 最多15位
+template <size_t N>
+static inline HuffmanCode DecodeSymbol(BitReader* reader, const HuffmanTable<N>& table) {
+    HuffmanCode here = table.codes[reader->Peek(table.rootBits)];
+    if (here.op != kOpLiteral && here.op <= kOpMaxLink) {
+        reader->Drop(table.rootBits);
+        here = table.codes[here.val + reader->Peek(here.op)];
+    }
+    reader->Drop(here.bits);
+    return here;
+}
+
+using LitLenTable = HuffmanTable<kLitLenTableSize>;
+using DistTable = HuffmanTable<kDistTableSize>;
+
+/// @brief 固定霍夫曼编码的解码表, 只构造一次
+struct FixedTables {
+    LitLenTable litLen;
+    DistTable dist;
+
+    FixedTables() {
+        uint8_t lens[kNumLitLenSymbols];
+        std::fill(lens, lens + 144, 8);
+        std::fill(lens + 144, lens + 256, 9);
+        std::fill(lens + 256, lens + 280, 7);
+        std::fill(lens + 280, lens + 288, 8);
+        BuildHuffmanTable(lens, kNumLitLenSymbols, Alphabet::kLitLen, kLitLenRootBits, false,
+                          &litLen);
+        std::fill(lens, lens + kNumDistSymbols, 5);
+        BuildHuffmanTable(lens, kNumDistSymbols, Alphabet::kDist, kDistRootBits, false, &dist);
+    }
+};
+
+static const FixedTables& GetFixedTables() {
+    static const FixedTables tables;
+    return tables;
+}
+
+/// @brief 读取动态霍夫曼块的头, 构造解码表
+static bool ReadDynamicTables(BitReader* reader, LitLenTable* litLen, DistTable* dist) {
+    reader->Refill();
+    unsigned numLitLen = reader->Read(5) + 257;
+    unsigned numDist = reader->Read(5) + 1;
+    unsigned numCodeLen = reader->Read(4) + 4;
+    if (numLitLen > kMaxDynamicLitLen || numDist > kMaxDynamicDist) {
+        return false;
+    }
+    uint8_t codeLens[kNumCodeLenSymbols] = {0};
+    for (unsigned i = 0; i < numCodeLen; i++) {
+        reader->Refill();
+        codeLens[kCodeLenOrder[i]] = static_cast<uint8_t>(reader->Read(3));
+    }
+    HuffmanTable<kCodeLenTableSize> codeLenTable;
+    if (!BuildHuffmanTable(codeLens, kNumCodeLenSymbols, Alphabet::kCodeLen, kCodeLenRootBits,
+                           false, &codeLenTable)) {
+        return false;
+    }
+    uint8_t lens[kMaxDynamicLitLen + kMaxDynamicDist];
+    unsigned total = numLitLen + numDist;
+    unsigned i = 0;
+    while (i < total) {
+        reader->Refill();
+        HuffmanCode code = DecodeSymbol(reader, codeLenTable);
+        if (code.op != kOpLiteral) {
+            return false;
+        }
+        if (code.val < 16) {
+            lens[i++] = static_cast<uint8_t>(code.val);
+            continue;
+        }
+        unsigned repeat;
+        uint8_t value = 0;
+        if (code.val == 16) {
+            if (i == 0) {
+                return false;
+            }
+            value = lens[i - 1];
+            repeat = 3 + reader->Read(2);
+        } else if (code.val == 17) {
+            repeat = 3 + reader->Read(3);
+        } else {
+            repeat = 11 + reader->Read(7);
+        }
+        if (repeat > total - i) {
+            return false;
+        }
+        std::fill(lens + i, lens + i + repeat, value);
+        i += repeat;
+    }
+    // 没有块结束符的编码无法结束
+    if (lens[kEndOfBlock] == 0) {
+        return false;
+    }
+    return BuildHuffmanTable(lens, numLitLen, Alphabet::kLitLen, kLitLenRootBits, true, litLen) &&
+           BuildHuffmanTable(lens + numLitLen, numDist, Alphabet::kDist, kDistRootBits, true,
+                             dist);
+}
+
+/// @brief 复制一个匹配, 调用前已检查距离和长度
+static inline void CopyMatch(uint8_t* out, uint8_t* outEnd, size_t distance, size_t length) {
+    const uint8_t* src = out - distance;
+    uint8_t* end = out + length;
+    if (distance >= 8 && static_cast<size_t>(outEnd - end) >= 8) {
+        // 距离至少8字节时每次复制的源数据都已写入, 多写的不超过7个字节, 之后会被覆盖
+        do {
+            memcpy(out, src, 8);
+            out += 8;
+            src += 8;
+        } while (out < end);
+    } else if (distance == 1) {
+        memset(out, out[-1], length);
+    } else {
+        while (out < end) {
+            *out++ = *src++;
+        }
+    }
+}
+
+/// @brief 解码一个霍夫曼块的数据
+/// @return 数据损坏或输出超过end返回false
+template <size_t L, size_t D>
+static bool DecodeBlock(BitReader* reader, const HuffmanTable<L>& litLen,
+                        const HuffmanTable<D>& dist, uint8_t* begin, uint8_t** cursor,
+                        uint8_t* end) {
+    uint8_t* out = *cursor;
+    while (true) {
+        // 补充后至少56位: 两个字面量最多30位, 长度码和额外位最多20位
+        reader->Refill();
+        HuffmanCode code = DecodeSymbol(reader, litLen);
+        if (code.op == kOpLiteral) {
+            if (out == end) {
+                return false;
+            }
+            *out++ = static_cast<uint8_t>(code.val);
+            code = DecodeSymbol(reader, litLen);
+            if (code.op == kOpLiteral) {
+                if (out == end) {
+                    return false;
+                }
+                *out++ = static_cast<uint8_t>(code.val);
+                continue;
+            }
+        }
+        if ((code.op & kOpBase) == 0) {
+            if (code.op == kOpEndOfBlock) {
+                break;
+            }
+            return false;
+        }
+        size_t length = code.val + reader->Read(code.op & kOpMaxLink);
+        // 距离码和额外位最多28位
+        reader->Refill();
+        code = DecodeSymbol(reader, dist);
+        if ((code.op & kOpBase) == 0) {
+            return false;
+        }
+        size_t distance = code.val + reader->Read(code.op & kOpMaxLink);
+        if (distance > static_cast<size_t>(out - begin) ||
+            length > static_cast<size_t>(end - out)) {
+            return false;
+        }
+        CopyMatch(out, end, distance, length);
+        out += length;
+    }
+    *cursor = out;
+    return true;
+}
+
+bool InflateOneShot(const uint8_t* in, size_t inSize, uint8_t* out, size_t size) {
+    BitReader reader(in, inSize);
+    uint8_t* cursor = out;
+    uint8_t* end = out + size;
+    bool last = false;
+    LitLenTable litLen;
+    DistTable dist;
+    while (!last) {
+        reader.Refill();
+        if (reader.Overrun()) {
+            return false;
+        }
+        last = reader.Read(1) != 0;
+        unsigned type = reader.Read(2);
+        if (type == 0) {
+            // stored块: 对齐到字节, LEN和NLEN之后是原始数据
+            reader.AlignToByte();
+            uint32_t length = reader.Read(16);
+            uint32_t complement = reader.Read(16);
+            if (length != (~complement & 0xffff) || !reader.Rewind() ||
+                length > reader.Remaining() || length > static_cast<size_t>(end - cursor)) {
+                return false;
+            }
+            memcpy(cursor, reader.Position(), length);
+            reader.Skip(length);
+            cursor += length;
+        } else if (type == 1) {
+            const FixedTables& fixed = GetFixedTables();
+            if (!DecodeBlock(&reader, fixed.litLen, fixed.dist, out, &cursor, end)) {
+                return false;
+            }
+        } else if (type == 2) {
+            if (!ReadDynamicTables(&reader, &litLen, &dist) ||
+                !DecodeBlock(&reader, litLen, dist, out, &cursor, end)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        if (reader.Overrun()) {
+            return false;
+        }
+    }
+    return cursor == end && reader.Consistent();
+}
+
+} // namespace apkparser
@@ -0,0 +1,39 @@
+#ifndef APKPARSER_INFLATE_H
+#define APKPARSER_INFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace apkparser {
+
+/// @brief 解压zip条目使用的deflate解码器, 可以在运行时切换用于对比测试
+enum class InflateBackend {
+    /// zlib流式解码
+    kZlib,
+    /// 内置的整块解码器: 输入和输出一次性给出, 不需要维护流状态和滑动窗口,
+    /// 失败时回退到zlib
+    kOneShot,
+};
+
+/// @brief 当前使用的解码器, 默认kOneShot
+InflateBackend GetInflateBackend();
+
+void SetInflateBackend(InflateBackend backend);
+
+const char* InflateBackendName(InflateBackend backend);
+
+/// @brief 用当前的解码器解压原始deflate数据, 解压后大小必须已知
+/// @return 数据损坏或解压后大小不等于size返回false
+bool Inflate(const uint8_t* in, size_t inSize, uint8_t* out, size_t size);
+
+/// @brief 用zlib解压原始deflate数据
+/// @param complete true时要求数据流恰好在size字节处结束; false时输出满size字节即停止
+bool InflateZlib(const uint8_t* in, uint64_t inSize, uint8_t* out, uint64_t size, bool complete);
+
+/// @brief 用内置的整块解码器解压原始deflate数据
+/// @return 数据损坏或解压后大小不等于size返回false
+bool InflateOneShot(const uint8_t* in, size_t inSize, uint8_t* out, size_t size);
+
+} // namespace apkparser
+
+#endif // APKPARSER_INFLATE_H
@@ -0,0 +1,98 @@
+#include "InflatePipeline.h"
+
+#include <algorithm>
+
+namespace apkparser {
+
+InflatePipeline::InflatePipeline(const ZipImage* image, std::vector<const ZipEntryInfo*> entries,
+                                 size_t threads, size_t queueDepth, uint64_t maxInflightBytes)
+      : image_(image),
+        entries_(std::move(entries)),
+        queueDepth_(std::max<size_t>(1, queueDepth)),
+        maxInflightBytes_(maxInflightBytes) {
+    threads = std::max<size_t>(1, std::min(threads, entries_.size()));
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads && !entries_.empty(); i++) {
+        threads_.emplace_back(&InflatePipeline::Run, this);
+    }
+}
+
+InflatePipeline::~InflatePipeline() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    consumed_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+uint64_t InflatePipeline::CostOf(const ZipEntryInfo* entry) const {
+    return entry != nullptr && entry->method != kZipMethodStored ? entry->uncompressedSize : 0;
+}
+
+void InflatePipeline::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        // 按顺序领取, 队列满或字节预算不足时等待解析线程消费
+        consumed_.wait(lock, [&]() {
+            if (stopped_ || nextEntry_ >= entries_.size()) {
+                return true;
+            }
+            uint64_t cost = CostOf(entries_[nextEntry_]);
+            return queue_.size() + inflating_ < queueDepth_ &&
+                   (inflightBytes_ == 0 || inflightBytes_ + cost <= maxInflightBytes_);
+        });
+        if (stopped_ || nextEntry_ >= entries_.size()) {
+            return;
+        }
+        Item item;
+        item.index = nextEntry_++;
+        item.bytes = CostOf(entries_[item.index]);
+        inflightBytes_ += item.bytes;
+        inflating_++;
+        lock.unlock();
+        const ZipEntryInfo* entry = entries_[item.index];
+        if (entry != nullptr) {
+            item.data = image_->OpenEntry(*entry);
+        }
+        lock.lock();
+        inflating_--;
+        if (item.data == nullptr) {
+            inflightBytes_ -= item.bytes;
+            item.bytes = 0;
+        }
+        queue_.push_back(std::move(item));
+        produced_.notify_one();
+    }
+}
+
+bool InflatePipeline::Pop(Item* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    produced_.wait(lock, [&]() { return !queue_.empty() || popped_ >= entries_.size(); });
+    if (queue_.empty()) {
+        return false;
+    }
+    *item = std::move(queue_.front());
+    queue_.pop_front();
+    popped_++;
+    if (popped_ >= entries_.size()) {
+        produced_.notify_all();
+    }
+    consumed_.notify_all();
+    return true;
+}
+
+void InflatePipeline::Release(const Item& item) {
+    if (item.bytes == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inflightBytes_ -= item.bytes;
+    }
+    consumed_.notify_all();
+}
+
+} // namespace apkparser
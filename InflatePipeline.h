@@ -0,0 +1,78 @@
+#ifndef APKPARSER_INFLATE_PIPELINE_H
+#define APKPARSER_INFLATE_PIPELINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "ZipImage.h"
+
+namespace apkparser {
+
+/// @brief 解压流水线: 构造后解压线程立即按顺序读取条目, 通过有界队列交给解析线程
+///
+/// 两个上限: 队列中和正在解压的条目数不超过queueDepth; 已解压但还没Release的字节数
+/// 不超过maxInflightBytes, 超过上限的单个条目在没有其它在途数据时仍然可以解压.
+/// stored条目直接返回映像中的视图, 不占用字节预算
+class InflatePipeline {
+public:
+    struct Item {
+        /// 条目在构造参数entries中的下标
+        size_t index = 0;
+        /// 读取失败时为nullptr
+        std::unique_ptr<aapt::io::IData> data;
+        /// 占用的在途字节数, Release时归还
+        uint64_t bytes = 0;
+    };
+
+private:
+    const ZipImage* image_;
+    std::vector<const ZipEntryInfo*> entries_;
+    size_t queueDepth_;
+    uint64_t maxInflightBytes_;
+
+    std::mutex mutex_;
+    // 队列中有数据或全部条目都已取出
+    std::condition_variable produced_;
+    // 队列有空位或在途字节减少
+    std::condition_variable consumed_;
+    std::deque<Item> queue_;
+    size_t nextEntry_ = 0;
+    size_t inflating_ = 0;
+    size_t popped_ = 0;
+    uint64_t inflightBytes_ = 0;
+    bool stopped_ = false;
+    std::vector<std::thread> threads_;
+
+    /// @brief 条目解压后占用的在途字节数
+    uint64_t CostOf(const ZipEntryInfo* entry) const;
+
+    void Run();
+
+public:
+    /// @param image 映像, 流水线存活期间必须有效
+    /// @param entries 要读取的条目, 为nullptr的条目得到data为nullptr的Item
+    /// @param threads 解压线程数, 至少为1
+    /// @param queueDepth 队列中和正在解压的最大条目数, 至少为1
+    /// @param maxInflightBytes 已解压未归还的最大字节数
+    InflatePipeline(const ZipImage* image, std::vector<const ZipEntryInfo*> entries,
+                    size_t threads, size_t queueDepth, uint64_t maxInflightBytes);
+
+    /// @brief 停止领取新条目, 等待解压线程退出
+    ~InflatePipeline();
+
+    InflatePipeline(const InflatePipeline&) = delete;
+    InflatePipeline& operator=(const InflatePipeline&) = delete;
+
+    /// @brief 取出一个读取完成的条目, 顺序不保证和entries一致, 可以在多个线程上调用
+    /// @return 所有条目都已取出返回false
+    bool Pop(Item* item);
+
+    /// @brief 条目处理完后归还在途字节
+    void Release(const Item& item);
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_INFLATE_PIPELINE_H
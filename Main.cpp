@@ -1,46 +1,130 @@
 #include <Apk.h>
+#include <Benchmark.h>
+#include <Bundle.h>
+#include <Inflate.h>
+#include <Prefetcher.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
 
 #include <json.hpp>
 
 using ::android::StringPiece;
 
 void printUseage() {
-    std::cout << "Usage: apkparser <command> <apk_path>" << std::endl;
+    std::cout << "Usage: apkparser [options] <command> <apk_path>..." << std::endl;
+    std::cout << "\t<apk_path> can be - to read a single apk from stdin" << std::endl;
     std::cout << "Commands:" << std::endl;
+    std::cout << "\tlist\t\tprint zip entries from the central directory only" << std::endl;
     std::cout << "\tmanifest\tprint manifest" << std::endl;
     std::cout << "\tstrings\t\tprint resources strings" << std::endl;
     std::cout << "\tdexes\t\tprint dexes" << std::endl;
+    std::cout << "\tdex-stream\tprint classes and strings dex by dex, deduplicated per dex only"
+              << std::endl;
+    std::cout << "\tdex-members\tprint dex type, field and method signatures" << std::endl;
+    std::cout << "\tinvokes\t\tprint methods, fields and strings referenced by dex code"
+              << std::endl;
     std::cout << "\tall\t\tprint all" << std::endl;
+    std::cout << "\tbundle\t\tprint all for every apk in an .apks/.xapk/.apkm bundle, merged"
+              << std::endl;
+    std::cout << "\tbench\t\tbenchmark string kernels on the apk's strings" << std::endl;
     std::cout << "\ttest\t\tthis is a test for fix bug" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "\t-j, --threads <n>\tdex parse and resource string decode threads, 0 means "
+                 "cpu count (default 1)"
+              << std::endl;
+    std::cout << "\t--dex-backend <auto|native|libdexfile>\tdex reader (default auto)"
+              << std::endl;
+    std::cout << "\t--insn-budget <n>\tmax instructions decoded per apk by invokes, 0 means "
+                 "unlimited (default 0)"
+              << std::endl;
+    std::cout << "\t--inflate-threads <n>\tthreads inflating compressed dexes, 0 means same as "
+                 "--threads (default 0)"
+              << std::endl;
+    std::cout << "\t--max-inflight-mb <n>\tmax inflated dex data waiting to be parsed (default "
+                 "512)"
+              << std::endl;
+    std::cout << "\t--inflate <oneshot|zlib>\tdeflate decoder for zip entries (default oneshot)"
+              << std::endl;
+    std::cout << "\t--prefetch <n>\twith several apks, open up to n apks ahead of the one being "
+                 "parsed, 0 disables (default 2)"
+              << std::endl;
+    std::cout << "\t--read-ahead-mb <n>\tentry data read ahead per prefetched apk (default 64)"
+              << std::endl;
+    std::cout << "\t--parallel-strings <n>\tdecode resource string pools with at least n strings "
+                 "on --threads threads, 0 disables (default 50000)"
+              << std::endl;
+    std::cout << "\t--dex-cache <dir>\tcache parsed dex results in dir" << std::endl;
+    std::cout << "\t--dex-cache-key <entry|header>\tkey cache by zip crc32+size or dex "
+                 "checksum+signature (default entry)"
+              << std::endl;
 }
 
-/**
- * 1. 解析manifest
- * 2. 解析资源字符串
- * 3. 解析dex类名和字符串
- */
-int main(int argc, char** argv) {
-    // Collect the arguments starting after the program name and command name.
-    std::vector<StringPiece> args;
-    for (int i = 1; i < argc; i++) {
-        args.push_back(argv[i]);
-    }
-    if (args.size() != 2) {
-        printUseage();
-        return -1;
+/// @brief list命令: 只读中央目录, 不加载apk
+static int ListApk(const std::string& path) {
+    std::string out;
+    auto visitor = [&out](const apkparser::ZipEntryInfo& entry) {
+        static const char kHex[] = "0123456789abcdef";
+        char fields[80];
+        int length = snprintf(fields, sizeof(fields), "%08x\t%u\t%" PRIu64 "\t%" PRIu64 "\t",
+                              entry.crc32, entry.method, entry.compressedSize,
+                              entry.uncompressedSize);
+        out.append(fields, length);
+        if (entry.extra.empty()) {
+            out.push_back('-');
+        }
+        for (unsigned char c : entry.extra) {
+            out.push_back(kHex[c >> 4]);
+            out.push_back(kHex[c & 0xf]);
+        }
+        out.append("\t").append(entry.name).append("\n");
+        if (out.size() >= 1 << 16) {
+            std::cout << out;
+            out.clear();
+        }
+        return true;
+    };
+    bool ok = path == "-" ? apkparser::Apk::ListEntriesFromFd(STDIN_FILENO, path, visitor)
+                          : apkparser::Apk::ListEntriesFromPath(path, visitor);
+    std::cout << out << std::flush;
+    return ok ? 0 : -1;
+}
+
+/// @brief 在已打开的映像上执行除list以外的命令
+static int RunCommand(const std::string& command, std::shared_ptr<apkparser::ZipImage> image,
+                      const apkparser::DexOptions& dexOptions,
+                      const apkparser::StringOptions& stringOptions) {
+    if (command == "bundle") {
+        // 内层apk直接从外层zip的映像中打开, 不解压到磁盘
+        auto bundle = apkparser::ApkBundle::LoadFromImage(std::move(image), dexOptions.threads);
+        if (!bundle) {
+            std::cerr << "load bundle failed" << std::endl;
+            return -1;
+        }
+        auto json = bundle->DoAllTasks(dexOptions, stringOptions);
+        if (!json) {
+            std::cerr << "parse bundle failed" << std::endl;
+            return -1;
+        }
+        std::cout << json.get()->dump(4, ' ', false, nlohmann::detail::error_handler_t::ignore)
+                  << std::endl;
+        return 0;
     }
-    std::string command = args[0].to_string();
-    std::string path = args[1].to_string();
     // 加载apk
-    auto apk = apkparser::Apk::LoadApkFromPath(path);
-    if (!apk) {
+    auto apkPtr = apkparser::Apk::LoadApkFromImage(std::move(image));
+    if (!apkPtr) {
         std::cerr << "load apk failed" << std::endl;
         return -1;
     }
+    const apkparser::Apk& apk = *apkPtr;
     if (command == "manifest") {
         // 解析manifest
-        auto result = apk->GetManifest();
+        auto result = apk.GetManifest();
         if (!result) {
             std::cerr << "parse manifest failed" << std::endl;
             return -1;
@@ -51,39 +135,292 @@ int main(int argc, char** argv) {
         std::cout << json.dump(4, ' ', false, nlohmann::detail::error_handler_t::ignore)
                   << std::endl;
     } else if (command == "strings") {
-        // 解析资源字符串
-        auto strings = apk->GetStrings();
-        if (!strings) {
+        // 解析资源字符串, 逐个输出, 不保存
+        std::string out;
+        bool ok = apk.VisitStrings([&out](std::string_view str) {
+            out.append(str).append("\n");
+            if (out.size() >= 1 << 16) {
+                std::cout << out;
+                out.clear();
+            }
+        });
+        std::cout << out << std::flush;
+        if (!ok) {
             std::cerr << "parse strings failed" << std::endl;
             return -1;
         }
-        for (const auto& str : *strings.get()) {
-            std::cout << str << std::endl;
-        }
     } else if (command == "dexes") {
         // 解析dexes
-        auto dexes = apk->ParseDexes();
+        auto dexes = apk.ParseDexes(dexOptions);
         if (!dexes) {
             std::cerr << "parse dexes failed" << std::endl;
             return -1;
         }
         // 按照json格式输出
         nlohmann::json json;
-        json["dex_classes"] = dexes.get()->first;
-        json["dex_strings"] = dexes.get()->second;
+        json["dex_classes"] = dexes->classes.Sorted();
+        json["dex_strings"] = dexes->strings.Sorted();
+        std::cout << json.dump(4, ' ', false, nlohmann::detail::error_handler_t::ignore)
+                  << std::endl;
+    } else if (command == "dex-stream") {
+        // 每行一项: <dex>\t<class|string>\t<value>, 只在dex内部去重, 每个dex输出后立即释放
+        std::string out;
+        apk.VisitDexes(dexOptions, [&out](const std::string& location,
+                                          apkparser::DexResult& result) {
+            const std::pair<const char*, apkparser::StringTable*> kinds[] = {
+                    {"class", &result.classes},
+                    {"string", &result.strings},
+            };
+            for (const auto& kind : kinds) {
+                for (std::string_view value : kind.second->Sorted()) {
+                    out.append(location).append("\t").append(kind.first).append("\t");
+                    out.append(value).append("\n");
+                    if (out.size() >= 1 << 16) {
+                        std::cout << out;
+                        out.clear();
+                    }
+                }
+            }
+        });
+        std::cout << out << std::flush;
+    } else if (command == "dex-members") {
+        // 每行一个签名: <dex>\t<type|field|method>\t<signature>, 每个dex输出后立即释放
+        std::string out;
+        apk.VisitDexMembers(dexOptions, [&out](const apkparser::DexMembers& members) {
+            const std::pair<const char*, const std::vector<std::string_view>*> kinds[] = {
+                    {"type", &members.types},
+                    {"field", &members.fields},
+                    {"method", &members.methods},
+            };
+            for (const auto& kind : kinds) {
+                for (std::string_view signature : *kind.second) {
+                    out.append(members.location).append("\t").append(kind.first).append("\t");
+                    out.append(signature).append("\n");
+                    if (out.size() >= 1 << 16) {
+                        std::cout << out;
+                        out.clear();
+                    }
+                }
+            }
+        });
+        std::cout << out << std::flush;
+    } else if (command == "invokes") {
+        auto invokes = apk.ParseInvokes(dexOptions);
+        nlohmann::json json;
+        json["invoked_methods"] = invokes->methods.Sorted();
+        json["accessed_fields"] = invokes->fields.Sorted();
+        json["const_strings"] = invokes->strings.Sorted();
+        json["truncated"] = invokes->truncated;
         std::cout << json.dump(4, ' ', false, nlohmann::detail::error_handler_t::ignore)
                   << std::endl;
     } else if (command == "all") {
-        auto json = apk->DoAllTasks();
+        auto json = apk.DoAllTasks(dexOptions, stringOptions);
         if (!json) {
             std::cerr << "parse all failed" << std::endl;
             return -1;
         }
         std::cout << json.get()->dump(4, ' ', false, nlohmann::detail::error_handler_t::ignore)
                   << std::endl;
-    } else {
+    } else if (command == "bench") {
+        if (!apkparser::RunBenchmarks(apk)) {
+            std::cerr << "benchmark failed" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 1. 解析manifest
+ * 2. 解析资源字符串
+ * 3. 解析dex类名和字符串
+ */
+int main(int argc, char** argv) {
+    // Collect the arguments starting after the program name and command name.
+    std::vector<StringPiece> args;
+    apkparser::DexOptions dexOptions;
+    apkparser::StringOptions stringOptions;
+    apkparser::ImagePrefetcher::Options prefetchOptions;
+    for (int i = 1; i < argc; i++) {
+        StringPiece arg = argv[i];
+        if (arg == "-j" || arg == "--threads") {
+            if (i + 1 >= argc || !android::base::ParseUint(argv[i + 1], &dexOptions.threads)) {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (arg == "--dex-backend") {
+            StringPiece value = i + 1 < argc ? argv[i + 1] : "";
+            if (value == "auto") {
+                dexOptions.backend = apkparser::DexBackend::kAuto;
+            } else if (value == "native") {
+                dexOptions.backend = apkparser::DexBackend::kNative;
+            } else if (value == "libdexfile") {
+                dexOptions.backend = apkparser::DexBackend::kLibdexfile;
+            } else {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (arg == "--insn-budget") {
+            if (i + 1 >= argc ||
+                !android::base::ParseUint(argv[i + 1], &dexOptions.instructionBudget)) {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (arg == "--inflate-threads") {
+            if (i + 1 >= argc ||
+                !android::base::ParseUint(argv[i + 1], &dexOptions.inflateThreads)) {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (arg == "--max-inflight-mb") {
+            uint64_t megabytes;
+            if (i + 1 >= argc || !android::base::ParseUint(argv[i + 1], &megabytes) ||
+                megabytes == 0 || megabytes > (UINT64_MAX >> 20)) {
+                printUseage();
+                return -1;
+            }
+            dexOptions.maxInflightBytes = megabytes << 20;
+            i++;
+            continue;
+        }
+        if (arg == "--inflate") {
+            StringPiece value = i + 1 < argc ? argv[i + 1] : "";
+            if (value == "oneshot") {
+                apkparser::SetInflateBackend(apkparser::InflateBackend::kOneShot);
+            } else if (value == "zlib") {
+                apkparser::SetInflateBackend(apkparser::InflateBackend::kZlib);
+            } else {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (arg == "--prefetch") {
+            if (i + 1 >= argc ||
+                !android::base::ParseUint(argv[i + 1], &prefetchOptions.queueDepth)) {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (arg == "--read-ahead-mb") {
+            uint64_t megabytes = 0;
+            if (i + 1 >= argc || !android::base::ParseUint(argv[i + 1], &megabytes) ||
+                megabytes > (UINT64_MAX >> 20)) {
+                printUseage();
+                return -1;
+            }
+            prefetchOptions.readAheadBytes = megabytes << 20;
+            i++;
+            continue;
+        }
+        if (arg == "--parallel-strings") {
+            if (i + 1 >= argc ||
+                !android::base::ParseUint(argv[i + 1], &stringOptions.parallelThreshold)) {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        if (arg == "--dex-cache") {
+            if (i + 1 >= argc) {
+                printUseage();
+                return -1;
+            }
+            dexOptions.cacheDir = argv[++i];
+            continue;
+        }
+        if (arg == "--dex-cache-key") {
+            StringPiece value = i + 1 < argc ? argv[i + 1] : "";
+            if (value == "entry") {
+                dexOptions.cacheKey = apkparser::DexCacheKey::kEntry;
+            } else if (value == "header") {
+                dexOptions.cacheKey = apkparser::DexCacheKey::kHeader;
+            } else {
+                printUseage();
+                return -1;
+            }
+            i++;
+            continue;
+        }
+        args.push_back(arg);
+    }
+    // 资源字符串池的并行解码同样受-j限制
+    stringOptions.threads = dexOptions.threads;
+    if (args.size() < 2) {
         printUseage();
         return -1;
     }
-    return 0;
+    std::string command = args[0].to_string();
+    static const char* const kCommands[] = {"list",       "manifest",    "strings", "dexes",
+                                            "dex-stream", "dex-members", "invokes", "all",
+                                            "bench",      "bundle"};
+    if (std::find(std::begin(kCommands), std::end(kCommands), command) == std::end(kCommands)) {
+        printUseage();
+        return -1;
+    }
+    std::vector<std::string> paths;
+    for (size_t i = 1; i < args.size(); i++) {
+        paths.push_back(args[i].to_string());
+    }
+    // stdin只能单独使用
+    if (paths.size() > 1 && std::find(paths.begin(), paths.end(), "-") != paths.end()) {
+        printUseage();
+        return -1;
+    }
+    // 多个apk时每个apk的输出前有一行 ==> path <==, 一个apk失败不影响后面的apk
+    bool multiple = paths.size() > 1;
+    int status = 0;
+    if (command == "list") {
+        for (const std::string& path : paths) {
+            if (multiple) {
+                std::cout << "==> " << path << " <==" << std::endl;
+            }
+            status = ListApk(path) != 0 ? -1 : status;
+        }
+        return status;
+    }
+    std::unique_ptr<apkparser::ImagePrefetcher> prefetcher;
+    if (multiple && prefetchOptions.queueDepth > 0) {
+        prefetcher.reset(new apkparser::ImagePrefetcher(paths, prefetchOptions));
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        const std::string& path = paths[i];
+        apkparser::ImagePrefetcher::Item item;
+        if (prefetcher) {
+            prefetcher->Next(&item);
+        } else if (path == "-") {
+            item.image = apkparser::ZipImage::OpenFd(STDIN_FILENO, path, &item.error);
+        } else {
+            item.image = apkparser::ZipImage::OpenPath(path, &item.error);
+        }
+        if (multiple) {
+            std::cout << "==> " << path << " <==" << std::endl;
+        }
+        if (!item.image) {
+            std::cerr << "failed opening zip: " << item.error << std::endl;
+            std::cerr << "load apk failed" << std::endl;
+            status = -1;
+            continue;
+        }
+        if (RunCommand(command, std::move(item.image), dexOptions, stringOptions) != 0) {
+            status = -1;
+        }
+    }
+    return status;
 }
@@ -0,0 +1,128 @@
+#ifndef APKPARSER_PARALLEL_H
+#define APKPARSER_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace apkparser {
+
+/// @brief 根据请求的线程数和任务数计算实际的工作线程数
+/// @param threads 请求的线程数, 0表示使用cpu核数
+/// @param count 任务数
+/// @return 至少为1
+inline size_t ResolveWorkerCount(size_t threads, size_t count) {
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    return std::max<size_t>(1, std::min(threads, count));
+}
+
+/// @brief 用多个线程执行count个任务, 线程从共享计数器中领取任务下标
+/// @param count 任务数
+/// @param threads 线程数, 0表示使用cpu核数, 1表示在当前线程串行执行
+/// @param task task(index, worker), worker为执行该任务的线程编号, 取值[0, workers)
+/// @return 实际使用的线程数
+inline size_t ParallelFor(size_t count, size_t threads,
+                          const std::function<void(size_t index, size_t worker)>& task) {
+    size_t workers = ResolveWorkerCount(threads, count);
+    if (workers == 1) {
+        for (size_t i = 0; i < count; i++) {
+            task(i, 0);
+        }
+        return workers;
+    }
+    std::atomic<size_t> next(0);
+    auto run = [&](size_t worker) {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            task(i, worker);
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (size_t w = 1; w < workers; w++) {
+        pool.emplace_back(run, w);
+    }
+    run(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    return workers;
+}
+
+/// @brief 并行执行count个任务, 并按下标顺序在一个线程上消费结果
+///
+/// 用于流式输出: 消费顺序和串行一致. 已领取但还没消费的任务最多为线程数的2倍,
+/// 慢任务不会导致其它结果无限堆积
+/// @param produce produce(index) 在工作线程上执行
+/// @param consume consume(index, value) 按下标顺序串行执行
+/// @return 实际使用的线程数
+template <typename T>
+size_t OrderedParallelFor(size_t count, size_t threads,
+                          const std::function<T(size_t index)>& produce,
+                          const std::function<void(size_t index, T&& value)>& consume) {
+    size_t workers = ResolveWorkerCount(threads, count);
+    if (workers == 1) {
+        for (size_t i = 0; i < count; i++) {
+            consume(i, produce(i));
+        }
+        return workers;
+    }
+    const size_t window = workers * 2;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::map<size_t, T> ready;
+    size_t nextClaim = 0;
+    size_t nextConsume = 0;
+    bool consuming = false;
+    auto run = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock,
+                      [&]() { return nextClaim >= count || nextClaim < nextConsume + window; });
+            if (nextClaim >= count) {
+                return;
+            }
+            size_t index = nextClaim++;
+            lock.unlock();
+            T value = produce(index);
+            lock.lock();
+            ready.emplace(index, std::move(value));
+            // 同一时间只有一个线程按顺序消费
+            if (consuming) {
+                continue;
+            }
+            consuming = true;
+            for (auto it = ready.find(nextConsume); it != ready.end();
+                 it = ready.find(nextConsume)) {
+                T current = std::move(it->second);
+                ready.erase(it);
+                lock.unlock();
+                consume(nextConsume, std::move(current));
+                lock.lock();
+                nextConsume++;
+                cond.notify_all();
+            }
+            consuming = false;
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (size_t w = 1; w < workers; w++) {
+        pool.emplace_back(run);
+    }
+    run();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    return workers;
+}
+
+} // namespace apkparser
+
+#endif // APKPARSER_PARALLEL_H
@@ -0,0 +1,86 @@
+#include "Prefetcher.h"
+
+#include <algorithm>
+
+namespace apkparser {
+
+ImagePrefetcher::ImagePrefetcher(std::vector<std::string> paths, const Options& options)
+      : paths_(std::move(paths)), options_(options), items_(paths_.size()), done_(paths_.size()) {
+    options_.queueDepth = std::max<size_t>(1, options_.queueDepth);
+    size_t threads = std::min(options_.queueDepth, paths_.size());
+    threads_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        threads_.emplace_back(&ImagePrefetcher::Run, this);
+    }
+}
+
+ImagePrefetcher::~ImagePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    taken_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ImagePrefetcher::ReadAhead(const ZipImage& image) const {
+    // 解析顺序: 加载时读resources.arsc, 然后是manifest和dex
+    std::vector<const ZipEntryInfo*> entries;
+    entries.push_back(image.Find("resources.arsc"));
+    entries.push_back(image.Find("AndroidManifest.xml"));
+    for (const ZipEntryInfo& entry : image.Entries()) {
+        if (entry.name.rfind(".dex") != std::string_view::npos) {
+            entries.push_back(&entry);
+        }
+    }
+    uint64_t remaining = options_.readAheadBytes;
+    for (const ZipEntryInfo* entry : entries) {
+        if (remaining == 0) {
+            break;
+        }
+        if (entry != nullptr) {
+            remaining -= image.Prefetch(*entry, remaining);
+        }
+    }
+}
+
+void ImagePrefetcher::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        taken_.wait(lock, [&]() {
+            return stopped_ || nextOpen_ >= paths_.size() ||
+                   nextOpen_ < nextTake_ + options_.queueDepth;
+        });
+        if (stopped_ || nextOpen_ >= paths_.size()) {
+            return;
+        }
+        size_t index = nextOpen_++;
+        lock.unlock();
+        Item item;
+        item.index = index;
+        item.image = ZipImage::OpenPath(paths_[index], &item.error);
+        if (item.image) {
+            ReadAhead(*item.image);
+        }
+        lock.lock();
+        items_[index] = std::move(item);
+        done_[index] = true;
+        ready_.notify_all();
+    }
+}
+
+bool ImagePrefetcher::Next(Item* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (nextTake_ >= paths_.size()) {
+        return false;
+    }
+    ready_.wait(lock, [&]() { return done_[nextTake_]; });
+    *item = std::move(items_[nextTake_]);
+    nextTake_++;
+    taken_.notify_all();
+    return true;
+}
+
+} // namespace apkparser
@@ -0,0 +1,71 @@
+#ifndef APKPARSER_PREFETCHER_H
+#define APKPARSER_PREFETCHER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "ZipImage.h"
+
+namespace apkparser {
+
+/// @brief 批量处理多个apk时, 后台线程提前打开后面的apk, 让文件读取和当前apk的解析重叠
+///
+/// 预读线程按顺序领取路径: 映射文件并解析中央目录, 再把resources.arsc、AndroidManifest.xml
+/// 和dex条目的原始数据读入内存, 解析线程取到映像时这些数据不会再因缺页阻塞在磁盘上.
+/// 已领取但还没被取走的apk不超过queueDepth个
+class ImagePrefetcher {
+public:
+    struct Options {
+        /// 同时预读的apk数, 也是预读线程数, 至少为1
+        size_t queueDepth = 2;
+        /// 每个apk最多预读的条目数据字节数
+        uint64_t readAheadBytes = 64ull << 20;
+    };
+
+    struct Item {
+        /// 在构造参数paths中的下标
+        size_t index = 0;
+        /// 打开失败时为nullptr
+        std::shared_ptr<ZipImage> image;
+        std::string error;
+    };
+
+private:
+    std::vector<std::string> paths_;
+    Options options_;
+
+    std::mutex mutex_;
+    // 有apk预读完成
+    std::condition_variable ready_;
+    // 有apk被取走
+    std::condition_variable taken_;
+    std::vector<Item> items_;
+    std::vector<bool> done_;
+    size_t nextOpen_ = 0;
+    size_t nextTake_ = 0;
+    bool stopped_ = false;
+    std::vector<std::thread> threads_;
+
+    void Run();
+
+    /// @brief 按解析时读取的顺序预读条目数据, 最多readAheadBytes字节
+    void ReadAhead(const ZipImage& image) const;
+
+public:
+    ImagePrefetcher(std::vector<std::string> paths, const Options& options);
+
+    /// @brief 停止领取新路径, 等待预读线程退出
+    ~ImagePrefetcher();
+
+    ImagePrefetcher(const ImagePrefetcher&) = delete;
+    ImagePrefetcher& operator=(const ImagePrefetcher&) = delete;
+
+    /// @brief 按paths的顺序取出下一个apk, 必要时等待它预读完成. 只能在一个线程上调用
+    /// @return 所有路径都已取出返回false
+    bool Next(Item* item);
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_PREFETCHER_H
@@ -0,0 +1,537 @@
+#include "StringKernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define APKPARSER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace apkparser {
+
+namespace {
+
+/// @brief 每个指令集的一组内核实现
+struct Kernels {
+    size_t (*findTrimChar)(const char* data, size_t size);
+    size_t (*normalizeClassName)(const char* src, size_t size, char* dest);
+    bool (*isAscii)(const char* data, size_t size);
+    size_t (*utf16ToUtf8)(const char16_t* src, size_t size, char* dest);
+};
+
+bool IsTrimChar(char c) {
+    return c == '\r' || c == '\n' || c == '\t';
+}
+
+size_t FindTrimCharScalar(const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (IsTrimChar(data[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+/// @brief 复制src到dest, 将/转换为., 遇到$停止
+/// @return 写入的长度
+size_t NormalizeClassNameScalar(const char* src, size_t size, char* dest) {
+    for (size_t i = 0; i < size; i++) {
+        char c = src[i];
+        if (c == '$') {
+            return i;
+        }
+        dest[i] = c == '/' ? '.' : c;
+    }
+    return size;
+}
+
+bool IsAsciiScalar(const char* data, size_t size) {
+    // 每次检查8个字节的最高位
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if ((word & 0x8080808080808080ULL) != 0) {
+            return false;
+        }
+    }
+    for (; i < size; i++) {
+        if (static_cast<uint8_t>(data[i]) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief 编码src[i]处的一个UTF-16字符, 代理对一起处理
+/// @return 消耗的代码单元数, 孤立的代理不输出
+inline size_t EncodeUtf16Char(const char16_t* src, size_t i, size_t size, char** out) {
+    uint32_t c = src[i];
+    char* dest = *out;
+    if (c < 0x80) {
+        *dest++ = static_cast<char>(c);
+    } else if (c < 0x800) {
+        *dest++ = static_cast<char>(0xC0 | (c >> 6));
+        *dest++ = static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0xD800 || c > 0xDFFF) {
+        *dest++ = static_cast<char>(0xE0 | (c >> 12));
+        *dest++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        *dest++ = static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0xDC00 && i + 1 < size && (src[i + 1] & 0xFC00) == 0xDC00) {
+        uint32_t codePoint = 0x10000 + ((c - 0xD800) << 10) + (src[i + 1] - 0xDC00);
+        *dest++ = static_cast<char>(0xF0 | (codePoint >> 18));
+        *dest++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        *dest++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *dest++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+        *out = dest;
+        return 2;
+    }
+    *out = dest;
+    return 1;
+}
+
+size_t Utf16ToUtf8Scalar(const char16_t* src, size_t size, char* dest) {
+    char* out = dest;
+    size_t i = 0;
+    while (i < size) {
+        i += EncodeUtf16Char(src, i, size, &out);
+    }
+    return out - dest;
+}
+
+#ifdef APKPARSER_X86
+
+size_t FindTrimCharSse2(const char* data, size_t size) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i tab = _mm_set1_epi8('\t');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hit =
+                _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, cr), _mm_cmpeq_epi8(chunk, lf)),
+                             _mm_cmpeq_epi8(chunk, tab));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + FindTrimCharScalar(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t FindTrimCharAvx2(const char* data, size_t size) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hit = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr), _mm256_cmpeq_epi8(chunk, lf)),
+                _mm256_cmpeq_epi8(chunk, tab));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    // dex和资源字符串大多很短, 尾部交给sse2处理
+    return i + FindTrimCharSse2(data + i, size - i);
+}
+
+size_t NormalizeClassNameSse2(const char* src, size_t size, char* dest) {
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i dollar = _mm_set1_epi8('$');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i isSlash = _mm_cmpeq_epi8(chunk, slash);
+        __m128i translated =
+                _mm_or_si128(_mm_andnot_si128(isSlash, chunk), _mm_and_si128(isSlash, dot));
+        // 整块写入, $之后多写的字节不计入长度
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), translated);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, dollar));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + NormalizeClassNameScalar(src + i, size - i, dest + i);
+}
+
+__attribute__((target("avx2"))) size_t NormalizeClassNameAvx2(const char* src, size_t size,
+                                                               char* dest) {
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i dot = _mm256_set1_epi8('.');
+    const __m256i dollar = _mm256_set1_epi8('$');
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i translated = _mm256_blendv_epi8(chunk, dot, _mm256_cmpeq_epi8(chunk, slash));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), translated);
+        uint32_t mask =
+                static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, dollar)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + NormalizeClassNameSse2(src + i, size - i, dest + i);
+}
+
+bool IsAsciiSse2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(chunk) != 0) {
+            return false;
+        }
+    }
+    return IsAsciiScalar(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) bool IsAsciiAvx2(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        if (_mm256_movemask_epi8(chunk) != 0) {
+            return false;
+        }
+    }
+    return IsAsciiSse2(data + i, size - i);
+}
+
+/// @brief 8个UTF-16单元都是ASCII时压缩成8个字节
+/// @return 不全是ASCII时只写入开头连续的ASCII字符, 返回它们的个数
+inline size_t PackAsciiSse2(__m128i chunk, char* out) {
+    const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chunk, nonAscii),
+                                                 _mm_setzero_si128()));
+    // 整块写入, 非ASCII字符的位置之后会被覆盖
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(chunk, chunk));
+    return mask == 0xFFFF ? 8 : __builtin_ctz(~mask) / 2;
+}
+
+/// @brief 8个UTF-16单元都在[0x80, 0x800)时编码为16个字节
+/// @return 有其他字符时不写入, 返回false
+inline bool EncodeTwoByteSse2(__m128i chunk, char* out) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i below800 = _mm_cmpeq_epi16(
+            _mm_and_si128(chunk, _mm_set1_epi16(static_cast<short>(0xF800))), zero);
+    __m128i ascii = _mm_cmpeq_epi16(
+            _mm_and_si128(chunk, _mm_set1_epi16(static_cast<short>(0xFF80))), zero);
+    if (_mm_movemask_epi8(_mm_andnot_si128(ascii, below800)) != 0xFFFF) {
+        return false;
+    }
+    // 每个16位单元的低字节是110xxxxx, 高字节是10xxxxxx, 按小端正好是输出顺序
+    __m128i lead = _mm_or_si128(_mm_srli_epi16(chunk, 6), _mm_set1_epi16(0xC0));
+    __m128i trail = _mm_or_si128(_mm_and_si128(chunk, _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_or_si128(lead, _mm_slli_epi16(trail, 8)));
+    return true;
+}
+
+/// @brief 编码src[i]开始的非ASCII字符, 直到遇到ASCII字符或end
+/// @return 新的位置, 代理对可能跨过end
+inline size_t EncodeNonAscii(const char16_t* src, size_t i, size_t end, size_t size, char** out) {
+    do {
+        i += EncodeUtf16Char(src, i, size, out);
+    } while (i < end && src[i] >= 0x80);
+    return i;
+}
+
+size_t Utf16ToUtf8Sse2(const char16_t* src, size_t size, char* dest) {
+    // 每个单元最多输出3个字节, 所以out不会超过dest + 3 * i, 整块写入不会越过dest的容量
+    char* out = dest;
+    size_t i = 0;
+    while (i + 8 <= size) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        size_t ascii = PackAsciiSse2(chunk, out);
+        out += ascii;
+        i += ascii;
+        if (ascii == 8) {
+            continue;
+        }
+        if (ascii == 0 && EncodeTwoByteSse2(chunk, out)) {
+            out += 16;
+            i += 8;
+            continue;
+        }
+        i = EncodeNonAscii(src, i, i - ascii + 8, size, &out);
+    }
+    while (i < size) {
+        i += EncodeUtf16Char(src, i, size, &out);
+    }
+    return out - dest;
+}
+
+/// @brief 8个UTF-16单元都是3字节的BMP字符(不含代理)时编码为24个字节
+/// @return 有其他字符时不写入, 返回false
+__attribute__((target("avx2"))) inline bool EncodeThreeByteAvx2(__m128i chunk, char* out) {
+    __m128i high = _mm_and_si128(chunk, _mm_set1_epi16(static_cast<short>(0xF800)));
+    __m128i other = _mm_or_si128(_mm_cmpeq_epi16(high, _mm_setzero_si128()),
+                                 _mm_cmpeq_epi16(high, _mm_set1_epi16(static_cast<short>(0xD800))));
+    if (_mm_movemask_epi8(other) != 0) {
+        return false;
+    }
+    __m128i first = _mm_or_si128(_mm_srli_epi16(chunk, 12), _mm_set1_epi16(0xE0));
+    __m128i second = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(chunk, 6), _mm_set1_epi16(0x3F)),
+                                  _mm_set1_epi16(0x80));
+    __m128i third = _mm_or_si128(_mm_and_si128(chunk, _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+    // 前两个字节按16位单元排列, 第三个字节压缩到低8字节, 再按每个字符3字节重排
+    __m128i leading = _mm_or_si128(first, _mm_slli_epi16(second, 8));
+    __m128i trailing = _mm_packus_epi16(third, third);
+    const __m128i leadingLow =
+            _mm_setr_epi8(0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10);
+    const __m128i trailingLow =
+            _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i leadingHigh =
+            _mm_setr_epi8(11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i trailingHigh =
+            _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i low = _mm_or_si128(_mm_shuffle_epi8(leading, leadingLow),
+                               _mm_shuffle_epi8(trailing, trailingLow));
+    __m128i high8 = _mm_or_si128(_mm_shuffle_epi8(leading, leadingHigh),
+                                 _mm_shuffle_epi8(trailing, trailingHigh));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), low);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16), high8);
+    return true;
+}
+
+__attribute__((target("avx2"))) size_t Utf16ToUtf8Avx2(const char16_t* src, size_t size,
+                                                        char* dest) {
+    const __m256i nonAscii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+    char* out = dest;
+    size_t i = 0;
+    while (i + 16 <= size) {
+        __m256i wide = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i ascii =
+                _mm256_cmpeq_epi16(_mm256_and_si256(wide, nonAscii), _mm256_setzero_si256());
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(ascii)) == 0xFFFFFFFF) {
+            // packus按128位通道交错, 拆成两半压缩
+            __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(wide),
+                                              _mm256_extracti128_si256(wide, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+            out += 16;
+            i += 16;
+            continue;
+        }
+        // 不全是ASCII时按8个单元处理, 中文等3字节字符也整块编码
+        __m128i chunk = _mm256_castsi256_si128(wide);
+        size_t asciiCount = PackAsciiSse2(chunk, out);
+        out += asciiCount;
+        i += asciiCount;
+        if (asciiCount == 8) {
+            continue;
+        }
+        if (asciiCount == 0 && EncodeTwoByteSse2(chunk, out)) {
+            out += 16;
+            i += 8;
+        } else if (asciiCount == 0 && EncodeThreeByteAvx2(chunk, out)) {
+            out += 24;
+            i += 8;
+        } else {
+            i = EncodeNonAscii(src, i, i - asciiCount + 8, size, &out);
+        }
+    }
+    return (out - dest) + Utf16ToUtf8Sse2(src + i, size - i, out);
+}
+
+#endif // APKPARSER_X86
+
+Kernels SelectKernels(SimdLevel level) {
+    switch (level) {
+#ifdef APKPARSER_X86
+        case SimdLevel::kAvx2:
+            return Kernels{FindTrimCharAvx2, NormalizeClassNameAvx2, IsAsciiAvx2, Utf16ToUtf8Avx2};
+        case SimdLevel::kSse2:
+            return Kernels{FindTrimCharSse2, NormalizeClassNameSse2, IsAsciiSse2, Utf16ToUtf8Sse2};
+#endif
+        default:
+            return Kernels{FindTrimCharScalar, NormalizeClassNameScalar, IsAsciiScalar,
+                           Utf16ToUtf8Scalar};
+    }
+}
+
+SimdLevel gLevel = DetectSimdLevel();
+Kernels gKernels = SelectKernels(gLevel);
+
+} // namespace
+
+SimdLevel DetectSimdLevel() {
+#ifdef APKPARSER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::kAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SimdLevel::kSse2;
+    }
+#endif
+    return SimdLevel::kScalar;
+}
+
+SimdLevel GetSimdLevel() {
+    return gLevel;
+}
+
+void SetSimdLevel(SimdLevel level) {
+    if (level > DetectSimdLevel()) {
+        level = DetectSimdLevel();
+    }
+    gLevel = level;
+    gKernels = SelectKernels(level);
+}
+
+const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::kAvx2:
+            return "avx2";
+        case SimdLevel::kSse2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+size_t FindTrimChar(const char* data, size_t size) {
+    return gKernels.findTrimChar(data, size);
+}
+
+size_t TrimInPlace(char* data, size_t size) {
+    size_t out = FindTrimChar(data, size);
+    if (out == size) {
+        return size;
+    }
+    // 从第一个需要删除的字符开始, 每次找到下一个需要删除的字符, 把中间的一段前移
+    size_t in = out + 1;
+    while (in < size) {
+        size_t next = in + FindTrimChar(data + in, size - in);
+        memmove(data + out, data + in, next - in);
+        out += next - in;
+        in = next + 1;
+    }
+    return out;
+}
+
+bool IsAscii(const char* data, size_t size) {
+    return gKernels.isAscii(data, size);
+}
+
+size_t Utf16ToUtf8(const char16_t* src, size_t size, char* dest) {
+    return gKernels.utf16ToUtf8(src, size, dest);
+}
+
+/// @brief 把码点编码为UTF-8追加到out
+static void AppendUtf8(uint32_t codePoint, std::string* out) {
+    if (codePoint < 0x80) {
+        out->push_back(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        out->push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        out->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        out->push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        out->push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+constexpr static uint32_t kReplacementChar = 0xFFFD;
+
+/// @brief 解码pos处的一个MUTF-8字符
+/// @return 码点, 非法序列返回U+FFFD; pos移动到下一个字符, 非法时只跳过一个字节
+static uint32_t DecodeMutf8(const uint8_t* data, size_t size, size_t* pos) {
+    auto isContinuation = [&](size_t at) { return at < size && (data[at] & 0xC0) == 0x80; };
+    size_t i = *pos;
+    uint8_t lead = data[i];
+    if (lead < 0x80) {
+        *pos = i + 1;
+        return lead;
+    }
+    if ((lead & 0xE0) == 0xC0 && isContinuation(i + 1)) {
+        uint32_t codePoint = ((lead & 0x1F) << 6) | (data[i + 1] & 0x3F);
+        // 只有\0允许使用两字节的过长编码
+        if (codePoint >= 0x80 || codePoint == 0) {
+            *pos = i + 2;
+            return codePoint;
+        }
+    } else if ((lead & 0xF0) == 0xE0 && isContinuation(i + 1) && isContinuation(i + 2)) {
+        uint32_t codePoint =
+                ((lead & 0x0F) << 12) | ((data[i + 1] & 0x3F) << 6) | (data[i + 2] & 0x3F);
+        if (codePoint >= 0x800) {
+            *pos = i + 3;
+            return codePoint;
+        }
+    } else if ((lead & 0xF8) == 0xF0 && isContinuation(i + 1) && isContinuation(i + 2) &&
+               isContinuation(i + 3)) {
+        // 标准UTF-8的4字节序列, 不属于MUTF-8, 但部分工具会生成, 合法时保留
+        uint32_t codePoint = ((lead & 0x07) << 18) | ((data[i + 1] & 0x3F) << 12) |
+                             ((data[i + 2] & 0x3F) << 6) | (data[i + 3] & 0x3F);
+        if (codePoint >= 0x10000 && codePoint <= 0x10FFFF) {
+            *pos = i + 4;
+            return codePoint;
+        }
+    }
+    *pos = i + 1;
+    return kReplacementChar;
+}
+
+void MutfToUtf8(std::string_view mutf8, std::string* out) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(mutf8.data());
+    size_t size = mutf8.size();
+    out->reserve(out->size() + size);
+    size_t pos = 0;
+    while (pos < size) {
+        // ASCII段整体拷贝
+        size_t start = pos;
+        while (pos < size && data[pos] < 0x80) {
+            pos++;
+        }
+        out->append(mutf8.data() + start, pos - start);
+        if (pos == size) {
+            break;
+        }
+        uint32_t codePoint = DecodeMutf8(data, size, &pos);
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+            // 高代理后面必须紧跟低代理
+            size_t next = pos;
+            uint32_t low = next < size ? DecodeMutf8(data, size, &next) : 0;
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                pos = next;
+            } else {
+                codePoint = kReplacementChar;
+            }
+        } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+            codePoint = kReplacementChar;
+        }
+        AppendUtf8(codePoint, out);
+    }
+}
+
+void NormalizeClassDescriptors(const std::vector<std::string_view>& descriptors,
+                               StringArena* arena, std::vector<std::string_view>* names) {
+    std::string_view previous;
+    bool hasPrevious = false;
+    for (std::string_view descriptor : descriptors) {
+        if (descriptor.size() < 2) {
+            continue;
+        }
+        size_t size = descriptor.size() - 2;
+        char* dest = arena->Reserve(size);
+        size_t length = gKernels.normalizeClassName(descriptor.data() + 1, size, dest);
+        std::string_view name(dest, length);
+        // 和上一个类名相同时不确认写入, 下一个类名覆盖这段空间
+        if (hasPrevious && name == previous) {
+            continue;
+        }
+        arena->Commit(length);
+        names->push_back(name);
+        previous = name;
+        hasPrevious = true;
+    }
+}
+
+} // namespace apkparser
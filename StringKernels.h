@@ -0,0 +1,66 @@
+#ifndef APKPARSER_STRING_KERNELS_H
+#define APKPARSER_STRING_KERNELS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "StringTable.h"
+
+namespace apkparser {
+
+/// @brief 字符串内核使用的指令集, 启动时按cpu能力选择, 可以手动覆盖用于对比测试
+enum class SimdLevel {
+    kScalar,
+    kSse2,
+    kAvx2,
+};
+
+/// @brief 当前cpu支持的最高指令集
+SimdLevel DetectSimdLevel();
+
+/// @brief 当前使用的指令集
+SimdLevel GetSimdLevel();
+
+/// @brief 切换指令集, 超过cpu能力时降级到DetectSimdLevel()
+void SetSimdLevel(SimdLevel level);
+
+const char* SimdLevelName(SimdLevel level);
+
+/// @brief 查找第一个\r \n \t
+/// @return 下标, 不存在返回size
+size_t FindTrimChar(const char* data, size_t size);
+
+/// @brief 原地删除所有\r \n \t, 一遍完成
+/// @return 删除后的长度
+size_t TrimInPlace(char* data, size_t size);
+
+/// @brief 是否全部是ASCII字符
+bool IsAscii(const char* data, size_t size);
+
+/// @brief 把UTF-16转换为UTF-8写入dest, dest至少要有3*size字节
+///
+/// 全是ASCII、全是2字节字符(西里尔字母等)和全是3字节字符(中日韩文字等, 需要avx2)的段
+/// 用向量指令整块转换. 代理对合并为4字节序列, 孤立的代理被丢弃, 和libutils的utf16_to_utf8一致
+/// @return 写入的字节数
+size_t Utf16ToUtf8(const char16_t* src, size_t size, char* dest);
+
+/// @brief 把dex使用的MUTF-8转换成标准UTF-8, 追加到out
+///
+/// 0xC0 0x80编码的\0转换为单字节\0, 用两个3字节序列编码的代理对合并为4字节序列,
+/// 孤立的代理和非法字节替换为U+FFFD
+void MutfToUtf8(std::string_view mutf8, std::string* out);
+
+/// @brief 批量把一个dex的类描述符转换为外部类名, 如 Lcom/a/B$C; -> com.a.B
+///
+/// 每个描述符只扫描一遍: 去掉首尾的L和;, 将/转换为., 在第一个$处截断,
+/// 结果直接写入arena. 内部类和匿名类通常紧跟在外部类之后, 连续相同的类名只输出一次
+/// @param descriptors 类描述符, 长度小于2的被忽略
+/// @param arena 类名存放的内存池
+/// @param names 追加输出的类名, 指向arena
+void NormalizeClassDescriptors(const std::vector<std::string_view>& descriptors,
+                               StringArena* arena, std::vector<std::string_view>* names);
+
+} // namespace apkparser
+
+#endif // APKPARSER_STRING_KERNELS_H
@@ -0,0 +1,145 @@
+#include "StringPool.h"
+#include "StringKernels.h"
+
+#include <androidfw/ResourceTypes.h>
+
+#include <cstring>
+
+namespace apkparser {
+
+bool StringPoolView::Open(const void* data, size_t size, std::string* error) {
+    const auto* header = reinterpret_cast<const android::ResStringPool_header*>(data);
+    if (size < sizeof(*header) || dtohs(header->header.type) != android::RES_STRING_POOL_TYPE) {
+        *error = "invalid string pool header";
+        return false;
+    }
+    size_t headerSize = dtohs(header->header.headerSize);
+    size_t chunkSize = dtohl(header->header.size);
+    if (headerSize < sizeof(*header) || headerSize > chunkSize || chunkSize > size) {
+        *error = "string pool chunk out of bounds";
+        return false;
+    }
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(data);
+    size_t count = dtohl(header->stringCount);
+    size_t styleCount = dtohl(header->styleCount);
+    // 字符串偏移表和样式偏移表紧跟在块头之后
+    if (count + styleCount > (chunkSize - headerSize) / sizeof(uint32_t)) {
+        *error = "string pool offsets out of bounds";
+        return false;
+    }
+    offsets_ = reinterpret_cast<const uint32_t*>(base + headerSize);
+    count_ = count;
+    utf8_ = (dtohl(header->flags) & android::ResStringPool_header::UTF8_FLAG) != 0;
+    if (count == 0) {
+        strings_ = nullptr;
+        stringsSize_ = 0;
+        return true;
+    }
+    size_t stringsStart = dtohl(header->stringsStart);
+    size_t stringsEnd = chunkSize;
+    if (styleCount != 0) {
+        stringsEnd = dtohl(header->stylesStart);
+    }
+    if (stringsStart < headerSize + (count + styleCount) * sizeof(uint32_t) ||
+        stringsStart >= stringsEnd || stringsEnd > chunkSize) {
+        *error = "string pool data out of bounds";
+        return false;
+    }
+    strings_ = base + stringsStart;
+    stringsSize_ = stringsEnd - stringsStart;
+    return true;
+}
+
+bool StringPoolView::GetUtf16(size_t index, const char16_t** chars, size_t* length) const {
+    if (utf8_ || index >= count_) {
+        return false;
+    }
+    // 和ResStringPool一样按16位单元寻址
+    const uint16_t* units = reinterpret_cast<const uint16_t*>(strings_);
+    size_t unitCount = stringsSize_ / sizeof(uint16_t);
+    size_t pos = dtohl(offsets_[index]) / sizeof(uint16_t);
+    if (pos >= unitCount) {
+        return false;
+    }
+    // 长度最高位为1时占两个单元
+    size_t size = dtohs(units[pos++]);
+    if ((size & 0x8000) != 0) {
+        if (pos >= unitCount) {
+            return false;
+        }
+        size = ((size & 0x7FFF) << 16) | dtohs(units[pos++]);
+    }
+    // 结尾还需要一个\0
+    if (size >= unitCount - pos) {
+        return false;
+    }
+    *chars = reinterpret_cast<const char16_t*>(units + pos);
+    *length = size;
+    return true;
+}
+
+/// @brief 读取UTF-8池中的长度, 最高位为1时占两个字节
+static bool DecodeUtf8Length(const uint8_t* data, size_t end, size_t* pos, size_t* length) {
+    if (*pos >= end) {
+        return false;
+    }
+    size_t value = data[(*pos)++];
+    if ((value & 0x80) != 0) {
+        if (*pos >= end) {
+            return false;
+        }
+        value = ((value & 0x7F) << 8) | data[(*pos)++];
+    }
+    *length = value;
+    return true;
+}
+
+bool StringPoolView::GetUtf8(size_t index, std::string_view* str) const {
+    if (!utf8_ || index >= count_) {
+        return false;
+    }
+    size_t pos = dtohl(offsets_[index]);
+    size_t utf16Length;
+    size_t size;
+    // 先是UTF-16长度, 再是UTF-8字节数
+    if (!DecodeUtf8Length(strings_, stringsSize_, &pos, &utf16Length) ||
+        !DecodeUtf8Length(strings_, stringsSize_, &pos, &size)) {
+        return false;
+    }
+    // 和ResStringPool一样拒绝没有\0结尾的字符串
+    if (size >= stringsSize_ - pos || strings_[pos + size] != 0) {
+        return false;
+    }
+    *str = std::string_view(reinterpret_cast<const char*>(strings_ + pos), size);
+    return true;
+}
+
+size_t StringPoolView::MaxUtf8Size(size_t index) const {
+    if (utf8_) {
+        std::string_view str;
+        return GetUtf8(index, &str) ? str.size() : 0;
+    }
+    const char16_t* chars;
+    size_t length;
+    // 每个UTF-16单元最多3个字节, 代理对两个单元共4个字节
+    return GetUtf16(index, &chars, &length) ? length * 3 : 0;
+}
+
+size_t StringPoolView::DecodeUtf8(size_t index, char* dest) const {
+    if (utf8_) {
+        std::string_view str;
+        if (!GetUtf8(index, &str)) {
+            return 0;
+        }
+        memcpy(dest, str.data(), str.size());
+        return str.size();
+    }
+    const char16_t* chars;
+    size_t length;
+    if (!GetUtf16(index, &chars, &length)) {
+        return 0;
+    }
+    return Utf16ToUtf8(chars, length, dest);
+}
+
+} // namespace apkparser
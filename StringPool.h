@@ -0,0 +1,52 @@
+#ifndef APKPARSER_STRING_POOL_H
+#define APKPARSER_STRING_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace apkparser {
+
+/// @brief ResStringPool块的只读视图
+///
+/// 直接读取块中的原始数据, 不像ResStringPool那样为每个UTF-16字符串分配并缓存解码结果.
+/// 偏移表和每个字符串都按块头检查边界, 越界的字符串视为不存在
+class StringPoolView {
+private:
+    const uint32_t* offsets_ = nullptr;
+    size_t count_ = 0;
+    const uint8_t* strings_ = nullptr;
+    /// 字符串数据的字节数, 到样式数据或块尾为止
+    size_t stringsSize_ = 0;
+    bool utf8_ = false;
+
+public:
+    /// @param data 以ResStringPool_header开头的块, 视图不持有数据
+    /// @return 块头或偏移表越界返回false
+    bool Open(const void* data, size_t size, std::string* error);
+
+    size_t size() const { return count_; }
+
+    bool IsUtf8() const { return utf8_; }
+
+    /// @brief UTF-16池中第index个字符串, 不含结尾的\0
+    /// @return 越界或不是UTF-16的池返回false
+    bool GetUtf16(size_t index, const char16_t** chars, size_t* length) const;
+
+    /// @brief UTF-8池中第index个字符串, 不含结尾的\0
+    /// @return 越界或不是UTF-8的池返回false
+    bool GetUtf8(size_t index, std::string_view* str) const;
+
+    /// @brief 第index个字符串转换为UTF-8后最多的字节数, 用于预分配, 越界返回0
+    size_t MaxUtf8Size(size_t index) const;
+
+    /// @brief 把第index个字符串以UTF-8写入dest, UTF-16的池按Utf16ToUtf8批量转换
+    /// @param dest 至少有MaxUtf8Size(index)字节
+    /// @return 写入的字节数, 越界返回0
+    size_t DecodeUtf8(size_t index, char* dest) const;
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_STRING_POOL_H
@@ -0,0 +1,168 @@
+#include "StringTable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace apkparser {
+
+char* StringArena::Allocate(size_t size) {
+    if (size > available_) {
+        // 超过块大小的字符串单独分配一块, 不浪费当前块的剩余空间
+        if (size > kBlockSize / 4) {
+            blocks_.emplace_back(new char[size]);
+            bytes_ += size;
+            return blocks_.back().get();
+        }
+        blocks_.emplace_back(new char[kBlockSize]);
+        cursor_ = blocks_.back().get();
+        available_ = kBlockSize;
+    }
+    char* result = cursor_;
+    cursor_ += size;
+    available_ -= size;
+    bytes_ += size;
+    return result;
+}
+
+char* StringArena::Reserve(size_t size) {
+    if (size > available_) {
+        size_t blockSize = std::max(size, kBlockSize);
+        blocks_.emplace_back(new char[blockSize]);
+        cursor_ = blocks_.back().get();
+        available_ = blockSize;
+    }
+    return cursor_;
+}
+
+std::string_view StringArena::Copy(std::string_view str) {
+    if (str.empty()) {
+        return std::string_view();
+    }
+    char* dest = Allocate(str.size());
+    memcpy(dest, str.data(), str.size());
+    return std::string_view(dest, str.size());
+}
+
+void StringArena::Adopt(StringArena&& other) {
+    // 保留当前块作为分配块, other的块只用于保持视图有效
+    if (blocks_.empty()) {
+        cursor_ = other.cursor_;
+        available_ = other.available_;
+    }
+    for (auto& block : other.blocks_) {
+        blocks_.push_back(std::move(block));
+    }
+    bytes_ += other.bytes_;
+    other.blocks_.clear();
+    other.cursor_ = nullptr;
+    other.available_ = 0;
+    other.bytes_ = 0;
+}
+
+/// @brief 能容纳count个元素且负载因子不超过0.5的2的幂
+static size_t SlotCapacity(size_t count) {
+    size_t capacity = 1024;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+void StringTable::Rehash(size_t capacity) {
+    slots_.assign(capacity, 0);
+    if (hashes_.size() != entries_.size()) {
+        hashes_.resize(entries_.size());
+        for (size_t i = 0; i < entries_.size(); i++) {
+            hashes_[i] = std::hash<std::string_view>()(entries_[i]);
+        }
+    }
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < entries_.size(); i++) {
+        size_t slot = hashes_[i] & mask;
+        while (slots_[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots_[slot] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+bool StringTable::Insert(std::string_view str, size_t hash, bool copy) {
+    // 负载因子不超过0.5
+    if ((entries_.size() + 1) * 2 > slots_.size()) {
+        Rehash(SlotCapacity(entries_.size() + 1));
+    }
+    size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+    while (slots_[slot] != 0) {
+        size_t index = slots_[slot] - 1;
+        if (hashes_[index] == hash && entries_[index] == str) {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+    entries_.push_back(copy ? arena_.Copy(str) : str);
+    hashes_.push_back(hash);
+    slots_[slot] = static_cast<uint32_t>(entries_.size());
+    sorted_ = entries_.size() == 1;
+    return true;
+}
+
+bool StringTable::Intern(std::string_view str) {
+    return Insert(str, std::hash<std::string_view>()(str), true);
+}
+
+bool StringTable::InternView(std::string_view str) {
+    return Insert(str, std::hash<std::string_view>()(str), false);
+}
+
+void StringTable::Merge(StringTable&& other) {
+    if (entries_.empty() && slots_.empty()) {
+        *this = std::move(other);
+        return;
+    }
+    // 插入前确保哈希有效, other的字符串已经在other的内存池中, 接管后直接引用
+    if (hashes_.size() != entries_.size()) {
+        Rehash(SlotCapacity(entries_.size() + other.entries_.size()));
+    }
+    for (size_t i = 0; i < other.entries_.size(); i++) {
+        size_t hash = i < other.hashes_.size() ? other.hashes_[i]
+                                               : std::hash<std::string_view>()(other.entries_[i]);
+        Insert(other.entries_[i], hash, false);
+    }
+    arena_.Adopt(std::move(other.arena_));
+    other.entries_.clear();
+    other.hashes_.clear();
+    other.slots_.clear();
+}
+
+bool StringTable::Contains(std::string_view str) const {
+    if (slots_.empty() || hashes_.size() != entries_.size()) {
+        if (sorted_) {
+            return std::binary_search(entries_.begin(), entries_.end(), str);
+        }
+        return std::find(entries_.begin(), entries_.end(), str) != entries_.end();
+    }
+    size_t hash = std::hash<std::string_view>()(str);
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask; slots_[slot] != 0; slot = (slot + 1) & mask) {
+        size_t index = slots_[slot] - 1;
+        if (hashes_[index] == hash && entries_[index] == str) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<std::string_view>& StringTable::Sorted() {
+    if (!sorted_) {
+        std::sort(entries_.begin(), entries_.end());
+        // 下标已经变化, 下次插入时重建索引
+        hashes_.clear();
+        slots_.clear();
+        sorted_ = true;
+    }
+    return entries_;
+}
+
+} // namespace apkparser
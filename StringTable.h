@@ -0,0 +1,123 @@
+#ifndef APKPARSER_STRING_TABLE_H
+#define APKPARSER_STRING_TABLE_H
+
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace apkparser {
+
+/// @brief 只追加的字符串内存池, 按块分配, 字符串连续存放, 整体释放
+class StringArena {
+private:
+    static constexpr size_t kBlockSize = 256 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* cursor_ = nullptr;
+    size_t available_ = 0;
+    size_t bytes_ = 0;
+
+public:
+    StringArena() = default;
+    /// 移动后other为空池, 默认的移动会留下指向已转移块的游标
+    StringArena(StringArena&& other) noexcept
+        : blocks_(std::move(other.blocks_)),
+          cursor_(std::exchange(other.cursor_, nullptr)),
+          available_(std::exchange(other.available_, 0)),
+          bytes_(std::exchange(other.bytes_, 0)) {
+        other.blocks_.clear();
+    }
+
+    StringArena& operator=(StringArena&& other) noexcept {
+        if (this != &other) {
+            blocks_ = std::move(other.blocks_);
+            other.blocks_.clear();
+            cursor_ = std::exchange(other.cursor_, nullptr);
+            available_ = std::exchange(other.available_, 0);
+            bytes_ = std::exchange(other.bytes_, 0);
+        }
+        return *this;
+    }
+
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    /// @brief 分配size字节, 不对齐
+    char* Allocate(size_t size);
+
+    /// @brief 保证当前块至少有size字节连续空间, 不移动游标
+    /// @return 可写入的起始地址, 写入后用Commit确认实际使用的字节数
+    char* Reserve(size_t size);
+
+    /// @brief 确认Reserve之后写入的size字节
+    void Commit(size_t size) {
+        cursor_ += size;
+        available_ -= size;
+        bytes_ += size;
+    }
+
+    /// @brief 将str拷贝进内存池
+    /// @return 指向内存池中副本的视图
+    std::string_view Copy(std::string_view str);
+
+    /// @brief 接管other的所有内存块, 之前从other得到的视图继续有效
+    void Adopt(StringArena&& other);
+
+    /// @brief 已经存放的字节数
+    size_t Bytes() const { return bytes_; }
+};
+
+/// @brief 字符串驻留表: 字符串存放在StringArena中, 用开放寻址的哈希索引去重
+///
+/// 每个字符串只保存一次, 插入时不排序, 需要输出时调用Sorted()排序一次
+class StringTable {
+private:
+    StringArena arena_;
+    std::vector<std::string_view> entries_;
+    std::vector<size_t> hashes_;
+    std::vector<uint32_t> slots_; // 存放entries_下标+1, 0表示空槽
+    bool sorted_ = true;
+
+    void Rehash(size_t capacity);
+    bool Insert(std::string_view str, size_t hash, bool copy);
+
+public:
+    StringTable() = default;
+    StringTable(StringTable&&) = default;
+    StringTable& operator=(StringTable&&) = default;
+    StringTable(const StringTable&) = delete;
+    StringTable& operator=(const StringTable&) = delete;
+
+    /// @brief 插入字符串, 不存在时拷贝进内存池
+    /// @return 新插入返回true, 已存在返回false
+    bool Intern(std::string_view str);
+
+    /// @brief 插入字符串, 不拷贝, 调用者保证str指向的内存在表的生命周期内有效
+    /// @return 新插入返回true, 已存在返回false
+    bool InternView(std::string_view str);
+
+    /// @brief 合并other, other的内存池被接管, 不拷贝字符串
+    void Merge(StringTable&& other);
+
+    bool Contains(std::string_view str) const;
+
+    size_t size() const { return entries_.size(); }
+
+    bool empty() const { return entries_.empty(); }
+
+    /// @brief 按字节序排序后的所有字符串, 只在有新插入时重新排序
+    const std::vector<std::string_view>& Sorted();
+
+    /// @brief 插入顺序(或上次排序后的顺序)的所有字符串
+    const std::vector<std::string_view>& Entries() const { return entries_; }
+
+    const StringArena& Arena() const { return arena_; }
+
+    /// @brief 表自身的内存池, 可以先把字符串直接写入其中, 再用InternView插入
+    StringArena* MutableArena() { return &arena_; }
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_STRING_TABLE_H
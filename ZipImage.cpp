@@ -0,0 +1,559 @@
+#include "ZipImage.h"
+
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include "Inflate.h"
+
+using ::android::base::StringPrintf;
+
+namespace apkparser {
+
+constexpr static uint32_t kLocalHeaderSignature = 0x04034b50;
+constexpr static uint32_t kCentralHeaderSignature = 0x02014b50;
+constexpr static uint32_t kEocdSignature = 0x06054b50;
+constexpr static uint32_t kZip64EocdLocatorSignature = 0x07064b50;
+constexpr static uint32_t kZip64EocdSignature = 0x06064b50;
+constexpr static size_t kLocalHeaderSize = 30;
+constexpr static size_t kCentralHeaderSize = 46;
+constexpr static size_t kEocdSize = 22;
+constexpr static size_t kZip64EocdLocatorSize = 20;
+constexpr static size_t kZip64EocdSize = 56;
+constexpr static size_t kMaxCommentSize = 0xffff;
+constexpr static uint16_t kZip64ExtraId = 0x0001;
+constexpr static uint16_t kFlagEncrypted = 0x0001;
+// deflate的最大压缩比约为1032:1, 超过时解压后的大小一定是伪造的
+constexpr static uint64_t kMaxDeflateRatio = 1032;
+
+static uint16_t ReadU16(const uint8_t* p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t ReadU32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t ReadU64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/// @brief 用zip64扩展字段替换中央目录中值为0xffffffff的大小和偏移
+static bool ApplyZip64Extra(ZipEntryInfo* entry) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(entry->extra.data());
+    size_t remaining = entry->extra.size();
+    while (remaining >= 4) {
+        uint16_t id = ReadU16(p);
+        uint16_t size = ReadU16(p + 2);
+        if (size > remaining - 4) {
+            return false;
+        }
+        if (id == kZip64ExtraId) {
+            // 只出现被标记为0xffffffff的字段, 顺序固定
+            const uint8_t* field = p + 4;
+            const uint8_t* end = field + size;
+            for (uint64_t* value : {&entry->uncompressedSize, &entry->compressedSize,
+                                    &entry->localHeaderOffset}) {
+                if (*value != UINT32_MAX) {
+                    continue;
+                }
+                if (end - field < 8) {
+                    return false;
+                }
+                *value = ReadU64(field);
+                field += 8;
+            }
+            return true;
+        }
+        p += 4 + size;
+        remaining -= 4 + size;
+    }
+    return entry->uncompressedSize != UINT32_MAX && entry->compressedSize != UINT32_MAX &&
+           entry->localHeaderOffset != UINT32_MAX;
+}
+
+/// @brief 查找中央目录的位置和条目数, 支持zip64
+static bool LocateCentralDirectory(const uint8_t* data, size_t size, uint64_t* offset,
+                                   uint64_t* length, uint64_t* count, std::string* error) {
+    if (size < kEocdSize) {
+        *error = "file too small to be a zip";
+        return false;
+    }
+    // 从文件末尾向前查找EOCD, 注释最长64KB
+    size_t eocd = size - kEocdSize;
+    size_t lowest = size > kEocdSize + kMaxCommentSize ? size - kEocdSize - kMaxCommentSize : 0;
+    while (ReadU32(data + eocd) != kEocdSignature) {
+        if (eocd == lowest) {
+            *error = "end of central directory not found";
+            return false;
+        }
+        eocd--;
+    }
+    *count = ReadU16(data + eocd + 10);
+    *length = ReadU32(data + eocd + 12);
+    *offset = ReadU32(data + eocd + 16);
+    if (eocd >= kZip64EocdLocatorSize &&
+        ReadU32(data + eocd - kZip64EocdLocatorSize) == kZip64EocdLocatorSignature) {
+        uint64_t zip64Eocd = ReadU64(data + eocd - kZip64EocdLocatorSize + 8);
+        // 文件可能比zip64 EOCD还小, 先比较大小避免相减下溢
+        if (size < kZip64EocdSize || zip64Eocd > size - kZip64EocdSize ||
+            ReadU32(data + zip64Eocd) != kZip64EocdSignature) {
+            *error = "invalid zip64 end of central directory";
+            return false;
+        }
+        *count = ReadU64(data + zip64Eocd + 32);
+        *length = ReadU64(data + zip64Eocd + 40);
+        *offset = ReadU64(data + zip64Eocd + 48);
+    }
+    if (*offset > size || *length > size - *offset) {
+        *error = "central directory out of bounds";
+        return false;
+    }
+    return true;
+}
+
+bool ZipImage::ForEachEntry(const uint8_t* data, size_t size,
+                            const std::function<bool(const ZipEntryInfo&)>& visitor,
+                            std::string* error) {
+    uint64_t offset, length, count;
+    if (!LocateCentralDirectory(data, size, &offset, &length, &count, error)) {
+        return false;
+    }
+    const uint8_t* p = data + offset;
+    const uint8_t* end = p + length;
+    for (uint64_t i = 0; i < count; i++) {
+        if (static_cast<size_t>(end - p) < kCentralHeaderSize ||
+            ReadU32(p) != kCentralHeaderSignature) {
+            *error = StringPrintf("invalid central directory entry %llu",
+                                  static_cast<unsigned long long>(i));
+            return false;
+        }
+        uint16_t nameLength = ReadU16(p + 28);
+        uint16_t extraLength = ReadU16(p + 30);
+        uint16_t commentLength = ReadU16(p + 32);
+        size_t recordSize = kCentralHeaderSize + nameLength + extraLength + commentLength;
+        if (static_cast<size_t>(end - p) < recordSize) {
+            *error = StringPrintf("central directory entry %llu out of bounds",
+                                  static_cast<unsigned long long>(i));
+            return false;
+        }
+        ZipEntryInfo entry;
+        entry.flags = ReadU16(p + 8);
+        entry.method = ReadU16(p + 10);
+        entry.modTime = ReadU16(p + 12);
+        entry.modDate = ReadU16(p + 14);
+        entry.crc32 = ReadU32(p + 16);
+        entry.compressedSize = ReadU32(p + 20);
+        entry.uncompressedSize = ReadU32(p + 24);
+        entry.localHeaderOffset = ReadU32(p + 42);
+        entry.name = std::string_view(reinterpret_cast<const char*>(p + kCentralHeaderSize),
+                                      nameLength);
+        entry.extra = std::string_view(entry.name.data() + nameLength, extraLength);
+        if (!ApplyZip64Extra(&entry)) {
+            *error = StringPrintf("invalid zip64 extra field in %.*s",
+                                  static_cast<int>(entry.name.size()), entry.name.data());
+            return false;
+        }
+        if (!visitor(entry)) {
+            return true;
+        }
+        p += recordSize;
+    }
+    return true;
+}
+
+ZipImage::~ZipImage() {
+    if (storage_ == Storage::kMapped) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    } else if (storage_ == Storage::kMalloced) {
+        free(const_cast<uint8_t*>(data_));
+    }
+}
+
+std::shared_ptr<ZipImage> ZipImage::OpenPath(const std::string& path, std::string* error) {
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        *error = StringPrintf("failed to open %s: %s", path.c_str(), strerror(errno));
+        return {};
+    }
+    return OpenFd(fd.get(), path, error);
+}
+
+std::shared_ptr<ZipImage> ZipImage::OpenFd(int fd, const std::string& name, std::string* error) {
+    std::shared_ptr<ZipImage> image = Load(fd, name, error);
+    if (!image || !image->Index(error)) {
+        return {};
+    }
+    return image;
+}
+
+bool ZipImage::ListEntries(int fd, const std::string& name,
+                           const std::function<bool(const ZipEntryInfo&)>& visitor,
+                           std::string* error) {
+    // mmap按需缺页, 只会读入EOCD和中央目录所在的页
+    std::shared_ptr<ZipImage> image = Load(fd, name, error);
+    return image && ForEachEntry(image->data_, image->size_, visitor, error);
+}
+
+std::shared_ptr<ZipImage> ZipImage::Load(int fd, const std::string& name, std::string* error) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        *error = StringPrintf("failed to stat %s: %s", name.c_str(), strerror(errno));
+        return {};
+    }
+    std::shared_ptr<ZipImage> image(new ZipImage());
+    image->path_ = name;
+    // 普通文件直接映射; 大小为0的普通文件可能是procfs等特殊文件, 和管道一样读取
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = static_cast<size_t>(st.st_size);
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            image->data_ = static_cast<const uint8_t*>(map);
+            image->size_ = size;
+            image->storage_ = Storage::kMapped;
+        }
+    }
+    if (image->storage_ == Storage::kNone && !image->ReadAll(fd, error)) {
+        return {};
+    }
+    return image;
+}
+
+std::shared_ptr<ZipImage> ZipImage::OpenMemory(const void* data, size_t size,
+                                               const std::string& name, std::string* error) {
+    std::shared_ptr<ZipImage> image(new ZipImage());
+    image->path_ = name;
+    image->data_ = static_cast<const uint8_t*>(data);
+    image->size_ = size;
+    image->storage_ = Storage::kBorrowed;
+    if (!image->Index(error)) {
+        return {};
+    }
+    return image;
+}
+
+std::shared_ptr<ZipImage> ZipImage::OpenData(std::unique_ptr<aapt::io::IData> data,
+                                             const std::string& name, std::string* error) {
+    std::shared_ptr<ZipImage> image = OpenMemory(data->data(), data->size(), name, error);
+    if (image) {
+        image->owner_ = std::move(data);
+    }
+    return image;
+}
+
+bool ZipImage::ReadAll(int fd, std::string* error) {
+    // 按倍数扩容, glibc对大块内存的realloc用mremap实现, 扩容时不拷贝数据
+    size_t capacity = 1 << 20;
+    size_t size = 0;
+    uint8_t* buffer = static_cast<uint8_t*>(malloc(capacity));
+    while (buffer != nullptr) {
+        if (size == capacity) {
+            capacity *= 2;
+            uint8_t* grown = static_cast<uint8_t*>(realloc(buffer, capacity));
+            if (grown == nullptr) {
+                break;
+            }
+            buffer = grown;
+        }
+        ssize_t n = read(fd, buffer + size, capacity - size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            *error = StringPrintf("failed to read %s: %s", path_.c_str(), strerror(errno));
+            free(buffer);
+            return false;
+        }
+        if (n == 0) {
+            data_ = buffer;
+            size_ = size;
+            storage_ = Storage::kMalloced;
+            return true;
+        }
+        size += static_cast<size_t>(n);
+    }
+    *error = StringPrintf("out of memory reading %s", path_.c_str());
+    free(buffer);
+    return false;
+}
+
+bool ZipImage::Index(std::string* error) {
+    entries_.clear();
+    index_.clear();
+    bool ok = ForEachEntry(
+            data_, size_,
+            [this](const ZipEntryInfo& entry) {
+                entries_.push_back(entry);
+                return true;
+            },
+            error);
+    if (!ok) {
+        return false;
+    }
+    index_.reserve(entries_.size());
+    for (size_t i = 0; i < entries_.size(); i++) {
+        // 和libziparchive一样拒绝重名的条目, 否则按名称查找和遍历得到的条目可能不同
+        if (!index_.emplace(entries_[i].name, i).second) {
+            *error = "duplicate entry: " + std::string(entries_[i].name);
+            return false;
+        }
+    }
+    return true;
+}
+
+const ZipEntryInfo* ZipImage::Find(std::string_view name) const {
+    auto it = index_.find(name);
+    return it == index_.end() ? nullptr : &entries_[it->second];
+}
+
+bool ZipImage::GetRawData(const ZipEntryInfo& entry, const uint8_t** data) const {
+    if ((entry.flags & kFlagEncrypted) != 0 || entry.localHeaderOffset > size_ ||
+        size_ - entry.localHeaderOffset < kLocalHeaderSize) {
+        return false;
+    }
+    const uint8_t* header = data_ + entry.localHeaderOffset;
+    if (ReadU32(header) != kLocalHeaderSignature) {
+        return false;
+    }
+    // 本地文件头的扩展字段长度可能和中央目录不同, 以本地文件头为准
+    uint64_t dataOffset =
+            entry.localHeaderOffset + kLocalHeaderSize + ReadU16(header + 26) + ReadU16(header + 28);
+    if (dataOffset > size_ || entry.compressedSize > size_ - dataOffset) {
+        return false;
+    }
+    *data = data_ + dataOffset;
+    return true;
+}
+
+uint64_t ZipImage::Prefetch(const ZipEntryInfo& entry, uint64_t maxBytes) const {
+    const uint8_t* raw;
+    if (storage_ != Storage::kMapped || !GetRawData(entry, &raw)) {
+        return 0;
+    }
+    size_t size = static_cast<size_t>(std::min(entry.compressedSize, maxBytes));
+    if (size == 0) {
+        return 0;
+    }
+    static const size_t kPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = reinterpret_cast<uintptr_t>(raw) & ~(kPageSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(raw) + size;
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+    uint8_t sum = 0;
+    for (uintptr_t page = begin; page < end; page += kPageSize) {
+        sum += *reinterpret_cast<const volatile uint8_t*>(std::max(page, uintptr_t(raw)));
+    }
+    (void)sum;
+    return size;
+}
+
+/// @brief 映像中一段数据的只读视图, 持有映像的引用
+class ImageData : public aapt::io::IData {
+private:
+    std::shared_ptr<const ZipImage> image_;
+    const uint8_t* data_;
+    size_t size_;
+    size_t nextRead_ = 0;
+
+public:
+    ImageData(std::shared_ptr<const ZipImage> image, const uint8_t* data, size_t size)
+          : image_(std::move(image)), data_(data), size_(size){};
+
+    const void* data() const override { return data_; }
+
+    size_t size() const override { return size_; }
+
+    bool Next(const void** data, size_t* size) override {
+        if (nextRead_ == size_) {
+            return false;
+        }
+        *data = data_ + nextRead_;
+        *size = size_ - nextRead_;
+        nextRead_ = size_;
+        return true;
+    }
+
+    void BackUp(size_t count) override {
+        nextRead_ -= std::min(count, nextRead_);
+    }
+
+    bool CanRewind() const override { return true; }
+
+    bool Rewind() override {
+        nextRead_ = 0;
+        return true;
+    }
+
+    size_t ByteCount() const override { return nextRead_; }
+
+    bool HadError() const override { return false; }
+};
+
+/// @brief 校验解压或拷贝后的数据的CRC32
+static bool CheckCrc32(const ZipEntryInfo& entry, const uint8_t* data) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    // crc32的长度参数是uInt, 大条目分段计算
+    for (uint64_t offset = 0; offset < entry.uncompressedSize;) {
+        uInt chunk =
+                static_cast<uInt>(std::min<uint64_t>(entry.uncompressedSize - offset, 1u << 30));
+        crc = crc32(crc, data + offset, chunk);
+        offset += chunk;
+    }
+    return static_cast<uint32_t>(crc) == entry.crc32;
+}
+
+std::unique_ptr<aapt::io::IData> ZipImage::OpenEntry(const ZipEntryInfo& entry) const {
+    const uint8_t* raw;
+    if (!GetRawData(entry, &raw) || entry.uncompressedSize > SIZE_MAX) {
+        return {};
+    }
+    if (entry.method == kZipMethodStored) {
+        if (entry.compressedSize != entry.uncompressedSize) {
+            return {};
+        }
+        if (reinterpret_cast<uintptr_t>(raw) % kZipDataAlignment == 0) {
+            return std::make_unique<ImageData>(shared_from_this(), raw, entry.uncompressedSize);
+        }
+        std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[entry.uncompressedSize]);
+        if (buffer == nullptr) {
+            return {};
+        }
+        memcpy(buffer.get(), raw, entry.uncompressedSize);
+        if (!CheckCrc32(entry, buffer.get())) {
+            return {};
+        }
+        return std::make_unique<aapt::io::MallocData>(std::move(buffer), entry.uncompressedSize);
+    }
+    if (entry.method != kZipMethodDeflated ||
+        entry.uncompressedSize > (entry.compressedSize + 1) * kMaxDeflateRatio) {
+        return {};
+    }
+    // 编译时关闭了异常, 分配失败不能让进程中止
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[entry.uncompressedSize]);
+    if (buffer == nullptr ||
+        !Inflate(raw, entry.compressedSize, buffer.get(), entry.uncompressedSize) ||
+        !CheckCrc32(entry, buffer.get())) {
+        return {};
+    }
+    return std::make_unique<aapt::io::MallocData>(std::move(buffer), entry.uncompressedSize);
+}
+
+bool ZipImage::ReadPrefix(const ZipEntryInfo& entry, size_t size, std::string* out) const {
+    const uint8_t* raw;
+    if (entry.uncompressedSize < size || !GetRawData(entry, &raw)) {
+        return false;
+    }
+    out->resize(size);
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(out->data());
+    if (entry.method == kZipMethodStored) {
+        if (entry.compressedSize < size) {
+            return false;
+        }
+        memcpy(buffer, raw, size);
+        return true;
+    }
+    return entry.method == kZipMethodDeflated &&
+           InflateZlib(raw, entry.compressedSize, buffer, size, /*complete=*/false);
+}
+
+/// @brief 映像中的一个文件, 读取时才解压
+class ZipImageFile : public aapt::io::IFile {
+private:
+    const ZipImage* image_;
+    const ZipEntryInfo* entry_;
+    aapt::Source source_;
+
+public:
+    ZipImageFile(const ZipImage* image, const ZipEntryInfo* entry)
+          : image_(image), entry_(entry), source_(std::string(entry->name), image->GetPath()){};
+
+    std::unique_ptr<aapt::io::IData> OpenAsData() override { return image_->OpenEntry(*entry_); }
+
+    std::unique_ptr<aapt::io::InputStream> OpenInputStream() override { return OpenAsData(); }
+
+    const aapt::Source& GetSource() const override { return source_; }
+
+    bool WasCompressed() override { return entry_->method != kZipMethodStored; }
+
+    bool GetModificationTime(struct tm* buf) const override {
+        // MS-DOS格式的日期和时间
+        memset(buf, 0, sizeof(struct tm));
+        buf->tm_year = ((entry_->modDate >> 9) & 0x7f) + 80;
+        buf->tm_mon = ((entry_->modDate >> 5) & 0xf) - 1;
+        buf->tm_mday = entry_->modDate & 0x1f;
+        buf->tm_hour = (entry_->modTime >> 11) & 0x1f;
+        buf->tm_min = (entry_->modTime >> 5) & 0x3f;
+        buf->tm_sec = (entry_->modTime & 0x1f) << 1;
+        buf->tm_isdst = -1;
+        return true;
+    }
+};
+
+/// @brief 按中央目录顺序遍历文件, 跳过目录
+class ZipImageFileIterator : public aapt::io::IFileCollectionIterator {
+private:
+    const std::vector<std::unique_ptr<aapt::io::IFile>>& files_;
+    size_t next_ = 0;
+
+    void SkipDirectories() {
+        while (next_ < files_.size() && files_[next_] == nullptr) {
+            next_++;
+        }
+    }
+
+public:
+    explicit ZipImageFileIterator(const std::vector<std::unique_ptr<aapt::io::IFile>>& files)
+          : files_(files) {
+        SkipDirectories();
+    }
+
+    bool HasNext() override { return next_ < files_.size(); }
+
+    aapt::io::IFile* Next() override {
+        aapt::io::IFile* file = files_[next_++].get();
+        SkipDirectories();
+        return file;
+    }
+};
+
+ZipImageFileCollection::ZipImageFileCollection(std::shared_ptr<ZipImage> image)
+      : image_(std::move(image)) {
+    const std::vector<ZipEntryInfo>& entries = image_->Entries();
+    files_.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!entries[i].name.empty() && entries[i].name.back() != '/') {
+            files_[i] = std::make_unique<ZipImageFile>(image_.get(), &entries[i]);
+        }
+    }
+}
+
+aapt::io::IFile* ZipImageFileCollection::FindFile(const android::StringPiece& path) {
+    const ZipEntryInfo* entry = image_->Find(std::string_view(path.data(), path.size()));
+    if (entry == nullptr) {
+        return nullptr;
+    }
+    return files_[entry - image_->Entries().data()].get();
+}
+
+std::unique_ptr<aapt::io::IFileCollectionIterator> ZipImageFileCollection::Iterator() {
+    return std::make_unique<ZipImageFileIterator>(files_);
+}
+
+} // namespace apkparser
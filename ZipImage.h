@@ -0,0 +1,162 @@
+#ifndef APKPARSER_ZIP_IMAGE_H
+#define APKPARSER_ZIP_IMAGE_H
+
+#include <io/Data.h>
+#include <io/File.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace apkparser {
+
+constexpr static uint16_t kZipMethodStored = 0;
+constexpr static uint16_t kZipMethodDeflated = 8;
+// 视图的对齐要求, ResTable和libdexfile按4字节对齐读取数据, zipalign保证stored条目满足这个对齐
+constexpr static size_t kZipDataAlignment = 4;
+
+/// @brief 中央目录中的一个条目, name和extra指向映像中的中央目录
+struct ZipEntryInfo {
+    std::string_view name;
+    std::string_view extra;
+    uint16_t method;
+    uint16_t flags;
+    uint16_t modTime;
+    uint16_t modDate;
+    uint32_t crc32;
+    uint64_t compressedSize;
+    uint64_t uncompressedSize;
+    uint64_t localHeaderOffset;
+};
+
+/// @brief 整个apk映射到内存中的只读映像, 中央目录只解析一次
+///
+/// 文件集合(ZipImageFileCollection)和资源加载都从同一个映像读取, 不再各自打开文件和解析目录
+class ZipImage : public std::enable_shared_from_this<ZipImage> {
+private:
+    /// @brief 映像数据的来源, 决定析构时如何释放
+    enum class Storage {
+        kNone,
+        kMapped,
+        kMalloced,
+        kBorrowed,
+    };
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    Storage storage_ = Storage::kNone;
+    std::string path_;
+    /// OpenData时持有数据, 例如外层zip中解压出的内层apk
+    std::unique_ptr<aapt::io::IData> owner_;
+    std::vector<ZipEntryInfo> entries_;
+    std::unordered_map<std::string_view, size_t> index_;
+
+    ZipImage() = default;
+
+    /// @brief 映射或读入fd的全部数据, 不解析中央目录
+    static std::shared_ptr<ZipImage> Load(int fd, const std::string& name, std::string* error);
+
+    bool Index(std::string* error);
+
+    /// @brief 把不能mmap的fd(管道、socket等)读到内存中
+    bool ReadAll(int fd, std::string* error);
+
+public:
+    ~ZipImage();
+    ZipImage(const ZipImage&) = delete;
+    ZipImage& operator=(const ZipImage&) = delete;
+
+    /// @brief mmap整个文件并解析中央目录
+    /// @return 失败返回nullptr
+    static std::shared_ptr<ZipImage> OpenPath(const std::string& path, std::string* error);
+
+    /// @brief 从已打开的fd创建映像, 不接管fd
+    ///
+    /// 普通文件直接mmap整个文件(与fd的当前读取位置无关); 管道等不能mmap的fd一直读到结束,
+    /// 数据读到一块内存中, 之后所有解析都从这块内存读取
+    /// @param name 用于错误信息和文件来源
+    static std::shared_ptr<ZipImage> OpenFd(int fd, const std::string& name, std::string* error);
+
+    /// @brief 从内存中的apk创建映像, 不拷贝数据
+    /// @param data 映像和它返回的视图存活期间必须有效
+    static std::shared_ptr<ZipImage> OpenMemory(const void* data, size_t size,
+                                                const std::string& name, std::string* error);
+
+    /// @brief 在IData上创建映像并接管它, 用于直接解析嵌套在外层zip中的apk
+    static std::shared_ptr<ZipImage> OpenData(std::unique_ptr<aapt::io::IData> data,
+                                              const std::string& name, std::string* error);
+
+    /// @brief 遍历中央目录, 不建立索引
+    /// @param visitor 返回false时停止遍历
+    /// @return 中央目录损坏返回false
+    static bool ForEachEntry(const uint8_t* data, size_t size,
+                             const std::function<bool(const ZipEntryInfo&)>& visitor,
+                             std::string* error);
+
+    /// @brief 只读取EOCD和中央目录, 逐个回调条目, 不建立索引也不读取任何条目数据
+    ///
+    /// 普通文件只有中央目录所在的页会被读入; 管道仍然需要读到结束
+    /// @param visitor 条目的name和extra只在回调期间有效
+    /// @return 打开失败或中央目录损坏返回false
+    static bool ListEntries(int fd, const std::string& name,
+                            const std::function<bool(const ZipEntryInfo&)>& visitor,
+                            std::string* error);
+
+    const std::string& GetPath() const { return path_; }
+
+    const uint8_t* data() const { return data_; }
+
+    size_t size() const { return size_; }
+
+    const std::vector<ZipEntryInfo>& Entries() const { return entries_; }
+
+    /// @brief 按名称查找条目
+    /// @return 不存在返回nullptr
+    const ZipEntryInfo* Find(std::string_view name) const;
+
+    /// @brief 条目数据(压缩后)在映像中的位置, 会解析本地文件头
+    /// @return 越界返回false
+    bool GetRawData(const ZipEntryInfo& entry, const uint8_t** data) const;
+
+    /// @brief 把条目的原始数据读入内存, 之后读取这部分映射不会再因缺页阻塞在磁盘上
+    ///
+    /// 先用MADV_WILLNEED让内核一次发起整段的读取, 再逐页访问等待读取完成. 不是mmap的映像什么都不做
+    /// @param maxBytes 最多读入的字节数
+    /// @return 读入的字节数
+    uint64_t Prefetch(const ZipEntryInfo& entry, uint64_t maxBytes) const;
+
+    /// @brief 读取条目解压后的内容
+    ///
+    /// 对齐的stored条目返回映像中的只读视图, 视图持有映像的引用, 不拷贝;
+    /// deflate条目和未对齐的stored条目返回新分配的缓冲区, 并校验CRC32.
+    /// 视图不校验CRC32: 校验需要读完整个条目, 会抵消按需读取映射的好处
+    /// @return 失败或CRC32不匹配返回nullptr
+    std::unique_ptr<aapt::io::IData> OpenEntry(const ZipEntryInfo& entry) const;
+
+    /// @brief 只读取条目解压后的前size个字节, deflate条目只解压需要的部分
+    /// @return 条目不足size字节或解压失败返回false
+    bool ReadPrefix(const ZipEntryInfo& entry, size_t size, std::string* out) const;
+};
+
+/// @brief 基于ZipImage的aapt文件集合, 和ZipImage共享同一份中央目录
+class ZipImageFileCollection : public aapt::io::IFileCollection {
+private:
+    std::shared_ptr<ZipImage> image_;
+    std::vector<std::unique_ptr<aapt::io::IFile>> files_;
+
+public:
+    explicit ZipImageFileCollection(std::shared_ptr<ZipImage> image);
+
+    aapt::io::IFile* FindFile(const android::StringPiece& path) override;
+
+    std::unique_ptr<aapt::io::IFileCollectionIterator> Iterator() override;
+
+    char GetDirSeparator() override { return '/'; }
+};
+
+} // namespace apkparser
+
+#endif // APKPARSER_ZIP_IMAGE_H